@@ -2,6 +2,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -10,6 +11,30 @@
 
 typedef struct Type Type;
 typedef struct Member Member;
+typedef struct Function Function;
+typedef struct TypeList TypeList;
+
+//
+// stats.c
+//
+
+// Kinds of objects whose allocations are counted
+typedef enum {
+  OBJ_TOKEN,
+  OBJ_NODE,
+  OBJ_TYPE,
+  OBJ_VAR,
+  OBJ_SCOPE, // Variable or struct tag scope entry
+  OBJ_KINDS,
+} ObjectKind;
+
+void *new_object(ObjectKind kind, int size);
+void begin_region();
+void end_region();
+void release_region();
+void start_phases();
+void end_phase(char *name);
+void print_stats(bool json);
 
 //
 // token.c
@@ -30,9 +55,11 @@ typedef struct Token Token;
 struct Token {
   TokenKind kind; // Type of a token
   Token *next;    // Next token
-  int val;        // Value of a token if its kind is TK_NUM
+  long val;       // Value of a token if its kind is TK_NUM
+  Type *type;     // Type of an integer literal
   char *str;      // String of a token
   int len;        // Length of a token
+  int line_no;    // Line number
 
   // Strings
   char *contents; // String literal contents including terminating '\0'
@@ -41,17 +68,33 @@ struct Token {
 
 // Type of variables
 typedef struct Var Var;
+typedef struct Initializer Initializer;
 struct Var {
   char *name;    // Name of a variable
   Type *type;    // Type of a variable
   bool is_local; // Whether a variable is local or not (global)
+  bool is_used;  // Whether a variable is referenced (set by dead code elim.)
 
   // Local variable
-  int offset; // Offset from RBP (base pointer)
+  int offset;      // Offset from RBP (base pointer)
+  char *reg;       // Register holding a parameter instead, or NULL
+  int scope_begin; // Lifetime in block scope numbers, or 0 if it lives
+  int scope_end;   // throughout the function
 
   // Global variable
-  char *contents; // String literal contents including terminating '\0'
-  int cont_len;   // String literal length
+  char *contents;           // String literal contents including '\0'
+  int cont_len;             // String literal length
+  Initializer *initializer; // Initial contents, or NULL if zero-filled
+  bool is_extern;           // Whether it is defined in another module
+};
+
+// Initial contents of a global variable. Each element is either `size`
+// bytes holding `val`, or an 8-byte address of `label` plus `val`.
+struct Initializer {
+  Initializer *next;
+  int size;
+  long val;
+  Var *label;
 };
 
 // List of variables
@@ -70,43 +113,66 @@ void expect(char *s);
 int expect_number();
 char *expect_ident();
 Token *tokenize();
+Token *tokenize_function();
 
 extern char *filename;
 extern char *user_input;
 extern Token *token;
 
+//
+// main.c
+//
+
+extern int inline_limit;
+extern bool use_avx2;
+extern char *profile_generate;
+extern bool instrument_functions;
+extern bool debug_info;
+extern bool pic;
+extern bool omit_frame_pointer;
+
 //
 // parse.c
 //
 
 // Kind of nodes in an abstract syntax tree (AST)
 typedef enum {
-  ND_ADD,       // num + num
-  ND_PTR_ADD,   // ptr + num or num + ptr
-  ND_SUB,       // num - num
-  ND_PTR_SUB,   // ptr - num
-  ND_PTR_DIFF,  // ptr - ptr
-  ND_MUL,       // *
-  ND_DIV,       // /
-  ND_EQ,        // ==
-  ND_NE,        // !=
-  ND_LT,        // <
-  ND_LE,        // <=
-  ND_ASSIGN,    // =
-  ND_MEMBER,    // . (struct member access)
-  ND_ADDR,      // & (address-of operator)
-  ND_DEREF,     // * (dereference operator)
-  ND_RETURN,    // "return"
-  ND_IF,        // "if"
-  ND_WHILE,     // "while"
-  ND_FOR,       // "for"
-  ND_EXPR_STMT, // Expression statement
-  ND_STMT_EXPR, // GNU statement expression
-  ND_BLOCK,     // Block (compound) statement { ... }
-  ND_CALL,      // Function call
-  ND_VAR,       // Variable
-  ND_NUM,       // Integer
-  ND_NULL,      // Empty expression
+  ND_ADD,        // num + num
+  ND_PTR_ADD,    // ptr + num or num + ptr
+  ND_SUB,        // num - num
+  ND_PTR_SUB,    // ptr - num
+  ND_PTR_DIFF,   // ptr - ptr
+  ND_MUL,        // *
+  ND_DIV,        // /
+  ND_EQ,         // ==
+  ND_NE,         // !=
+  ND_LT,         // <
+  ND_LE,         // <=
+  ND_ASSIGN,     // =
+  ND_OP_ASSIGN,  // +=, -=, *=, /=, ++ or --
+  ND_LHS_VAL,    // Value of the left operand in ND_OP_ASSIGN
+  ND_MEMBER,     // . (struct member access)
+  ND_ADDR,       // & (address-of operator)
+  ND_DEREF,      // * (dereference operator)
+  ND_CAST,       // Implicit integer conversion
+  ND_RETURN,     // "return"
+  ND_IF,         // "if"
+  ND_WHILE,      // "while"
+  ND_FOR,        // "for"
+  ND_SWITCH,     // "switch"
+  ND_CASE,       // "case" or "default" label
+  ND_BREAK,      // "break"
+  ND_EXPR_STMT,  // Expression statement
+  ND_STMT_EXPR,  // GNU statement expression
+  ND_BLOCK,      // Block (compound) statement { ... }
+  ND_CALL,       // Function call
+  ND_INLINE,     // Inlined function call
+  ND_INLINE_RET, // "return" in an inlined function body
+  ND_VLOOP,      // Vectorized part of a "for" loop
+  ND_MEMZERO,    // Zero-fill a variable
+  ND_VAR,        // Variable
+  ND_NUM,        // Integer
+  ND_NULL,       // Empty expression
 } NodeKind;
 
 // Type of nodes in an abstract syntax tree (AST)
@@ -120,9 +186,12 @@ struct Node {
   Node *lhs; // Left-hand side
   Node *rhs; // Right-hand side
 
-  // "if", "while" or "for" statement
-  Node *cond; // Condition in "if", "while" or "for"
-  Node *cons; // Consequence in "if", "whle" or "for"
+  // Whether a "++" or "--" evaluates to the value before the update
+  bool is_postfix;
+
+  // "if", "while", "for" or "switch" statement
+  Node *cond; // Condition in "if", "while" or "for", or value of "switch"
+  Node *cons; // Consequence in "if", "whle" or "for", or body of "switch"
   Node *alt;  // Alternative in "if"
   Node *init; // Initialization in "for"
   Node *updt; // Update in "for"
@@ -136,35 +205,125 @@ struct Node {
   // Function call or definition
   char *func_name; // Function name
   Node *args;      // Function arguments
+  Function *func;  // Declaration of the callee, or NULL if implicitly declared
 
   Var *var; // Variable itself if kind is ND_VAR
-  long val; // Value of an integer if kind is ND_NUM
+  long val; // Value of an integer if kind is ND_NUM, or of a "case" label
+
+  // "case" or "default" label, whose statement is `lhs`
+  bool is_default;
+  int label; // Label number, assigned when the enclosing "switch" is generated
+
+  int prof_id; // First profile counter of "if", "while" or "for"
 };
 
 // Type of functions
-typedef struct Function Function;
 struct Function {
-  char *name;      // Name of a function
-  VarList *params; // Parameters of a function
+  char *name;            // Name of a function
+  Token *tok;            // Token of the name
+  Type *return_type;     // Return type of a function
+  VarList *params;       // Parameters of a function
+  TypeList *param_types; // Types of the parameters, kept after they're freed
+  int n_params;          // Number of parameters
+  bool is_variadic;      // Whether a function takes variable arguments
+  bool is_static;        // Whether a function is local to the translation unit
 
   Node *node;      // The first statement in a function
   VarList *locals; // Local variables
   int stack_size;  // Stack size
+  bool is_leaf;    // Whether it calls no function after inlining
+  int prof_id;     // Profile counter of entries
 
   Function *next; // Next function
 };
 
+struct TypeList {
+  TypeList *next;
+  Type *type;
+};
+
 typedef struct {
   VarList *globals;
   Function *fns;
+  TypeList *structs; // Struct types in order of definition
 } Program;
 
+Function *next_function();
 Program *program();
+Program *new_program(Function *fns);
+
+//
+// consteval.c
+//
+
+extern int constexpr_steps;
+
+void consteval_function(Program *p, Function *fn);
+void consteval_calls(Program *p);
+
+//
+// inline.c
+//
+
+bool is_inline_candidate(Function *fn);
+Function *copy_for_inlining(Function *fn);
+void inline_function(Program *prog, Function *fn);
+void inline_functions(Program *prog);
+
+//
+// dce.c
+//
+
+bool has_case_label(Node *node);
+long extend_const(long val, Type *type);
+bool fold_binary(Node *node, long lhs, long rhs, long *val);
+bool may_escape_local(Node *node);
+void dce_function(Function *fn);
+void eliminate_dead_code(Program *prog);
+
+//
+// licm.c
+//
+
+void licm_function(Function *fn);
+void hoist_loop_invariants(Program *prog);
+
+//
+// vectorize.c
+//
+
+void vectorize_function(Function *fn);
+void vectorize_loops(Program *prog);
+
+//
+// profile.c
+//
+
+extern int n_prof_counters;
+
+void assign_function_counters(Function *fn);
+void assign_profile_counters(Program *prog);
+void read_profile(Program *prog, char *path);
+bool is_unlikely(Node *node);
+bool is_cold_branch(Node *node);
+bool is_cold_else(Node *node);
+bool is_cold_function(Function *fn);
+bool is_hot_function(Function *fn);
+
+//
+// layout.c
+//
+
+void assign_frame_layout(Function *fn);
+void report_struct_layout(Program *prog);
 
 //
 // codegen.c
 //
 
+void begin_codegen();
+void emit_function(Function *fn);
+void end_codegen(Program *prog);
 void codegen(Program *prog);
 
 //
@@ -173,19 +332,23 @@ void codegen(Program *prog);
 
 typedef enum {
   TYPE_CHAR,
+  TYPE_SHORT,
   TYPE_INT,
+  TYPE_LONG,
   TYPE_PTR,
   TYPE_ARRAY,
   TYPE_STRUCT,
 } TypeKind;
 
 struct Type {
-  TypeKind kind;   // Kind of type
-  int size;        // sizeof() value
-  int align;       // Alignment
-  Type *base;      // Base type
-  int array_len;   // Length of an array
-  Member *members; // Struct members
+  TypeKind kind;    // Kind of type
+  int size;         // sizeof() value
+  int align;        // Alignment
+  bool is_unsigned; // Whether an integer type is unsigned
+  Type *base;       // Base type
+  int array_len;    // Length of an array
+  Member *members;  // Struct members
+  char *name;       // Struct tag, or NULL if anonymous
 };
 
 // Struct member
@@ -197,10 +360,19 @@ struct Member {
 };
 
 bool is_integer(Type *type);
+bool is_same_type(Type *a, Type *b);
 int align_to(int n, int align);
 Type *pointer_to(Type *type);
 Type *array_of(Type *base, int size);
+Type *common_type(Type *ty1, Type *ty2);
+bool is_unsigned_cmp(Node *node);
 void add_type(Node *node);
 
 extern Type *char_type;
+extern Type *short_type;
 extern Type *int_type;
+extern Type *long_type;
+extern Type *uchar_type;
+extern Type *ushort_type;
+extern Type *uint_type;
+extern Type *ulong_type;
@@ -0,0 +1,191 @@
+// Generates synthetic C programs in the subset of C which 9cc supports, for
+// measuring the throughput of the compiler.
+//
+// usage: gen <kind> <n>
+//
+// The size of the output grows linearly with `n` for every kind:
+//
+//   functions: `n` small functions calling each other
+//   exprs:     functions with expressions nested `n` levels deep
+//   structs:   a struct of `n` members and functions accessing them
+//   globals:   `n` initialized global scalars, arrays and pointers
+//   strings:   `n` string literals
+//   huge:      all of the above in a single file
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Functions f0 .. f(n-1), each calling the previous one
+void gen_functions(int n) {
+  printf("int f0(int a, int b) { return a + b; }\n");
+  for (int i = 1; i < n; i++) {
+    printf("int f%d(int a, int b) {\n", i);
+    printf("  int x;\n");
+    printf("  int y;\n");
+    printf("  x = a * %d + b;\n", i % 7 + 1);
+    printf("  y = 0;\n");
+    printf("  for (x = 0; x < %d; x = x + 1) {\n", i % 5 + 2);
+    printf("    if (x == b) {\n");
+    printf("      y = y + f%d(x, a);\n", i - 1);
+    printf("    } else {\n");
+    printf("      y = y - x / %d;\n", i % 3 + 1);
+    printf("    }\n");
+    printf("  }\n");
+    printf("  return y;\n");
+    printf("}\n");
+  }
+  printf("int bench_functions() { return f%d(1, 2); }\n", n - 1);
+}
+
+// Prints an expression nested `depth` levels deep.
+void gen_expr(int depth) {
+  static char *ops[] = {"+", "-", "*", "+", "-"};
+  if (depth == 0) {
+    printf("a");
+    return;
+  }
+  printf("(");
+  gen_expr(depth - 1);
+  printf(" %s %d)", ops[depth % 5], depth % 9 + 1);
+}
+
+// Functions evaluating deeply nested expressions. Nesting is capped so that
+// the recursive descent parser doesn't run out of stack, and more functions
+// are generated instead.
+void gen_exprs(int n) {
+  int depth = n < 200 ? n : 200;
+  int count = n / depth + 1;
+  for (int i = 0; i < count; i++) {
+    printf("long e%d(long a) {\n", i);
+    printf("  long b;\n");
+    printf("  b = ");
+    gen_expr(depth);
+    printf(";\n");
+    printf("  return b == a + 1 + 2 * 3 - 4 * a / 5 + (a - 6) * (a + 7);\n");
+    printf("}\n");
+  }
+  printf("int bench_exprs() { return e0(1); }\n");
+}
+
+// A large struct of mixed member types and functions copying and updating it
+void gen_structs(int n) {
+  static char *types[] = {"char", "short", "int", "long", "char *"};
+  printf("struct S {\n");
+  for (int i = 0; i < n; i++) {
+    printf("  %s m%d;\n", types[i % 5], i);
+  }
+  printf("  int a[%d];\n", n);
+  printf("} s0;\n");
+
+  printf("int update(struct S *p) {\n");
+  for (int i = 0; i < n; i++) {
+    if (i % 5 != 4) {
+      printf("  p->m%d = %d;\n", i, i % 100);
+    }
+  }
+  printf("  return sizeof(*p);\n");
+  printf("}\n");
+
+  printf("int bench_structs() {\n");
+  printf("  struct S s;\n");
+  printf("  struct S t;\n");
+  printf("  update(&s);\n");
+  printf("  t = s;\n");
+  printf("  s0 = t;\n");
+  printf("  return t.m0 + s0.m%d;\n", n > 1 ? 1 : 0);
+  printf("}\n");
+}
+
+// Initialized global scalars, arrays, pointers and a function summing them
+void gen_globals(int n) {
+  for (int i = 0; i < n; i++) {
+    switch (i % 4) {
+    case 0:
+      printf("int g%d = %d;\n", i, i);
+      break;
+    case 1:
+      printf("long g%d[4] = {%d, %d, %d};\n", i, i, i + 1, i + 2);
+      break;
+    case 2:
+      printf("int *g%d = &g%d;\n", i, i - 2);
+      break;
+    default:
+      printf("char g%d[8];\n", i);
+    }
+  }
+
+  printf("long bench_globals() {\n");
+  printf("  long sum;\n");
+  printf("  sum = 0;\n");
+  for (int i = 0; i < n; i++) {
+    switch (i % 4) {
+    case 0:
+      printf("  sum = sum + g%d;\n", i);
+      break;
+    case 1:
+      printf("  sum = sum + g%d[2];\n", i);
+      break;
+    case 2:
+      printf("  sum = sum + *g%d;\n", i);
+      break;
+    default:
+      printf("  g%d[0] = sum;\n", i);
+    }
+  }
+  printf("  return sum;\n");
+  printf("}\n");
+}
+
+// String literals in global initializers and in function bodies
+void gen_strings(int n) {
+  for (int i = 0; i < n; i++) {
+    printf("char *str%d = \"string literal number %d\\n\";\n", i, i);
+  }
+
+  printf("int bench_strings() {\n");
+  printf("  char *p;\n");
+  printf("  int len;\n");
+  printf("  len = 0;\n");
+  for (int i = 0; i < n; i++) {
+    printf("  p = \"local string %d with some\\tescapes\\\\\";\n", i);
+    printf("  len = len + sizeof(\"%d\") + p[0] + str%d[1];\n", i, i);
+  }
+  printf("  return len;\n");
+  printf("}\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <kind> <n>\n", argv[0]);
+    return 1;
+  }
+  char *kind = argv[1];
+  int n = atoi(argv[2]);
+  if (n < 1) {
+    n = 1;
+  }
+
+  if (!strcmp(kind, "functions")) {
+    gen_functions(n);
+  } else if (!strcmp(kind, "exprs")) {
+    gen_exprs(n);
+  } else if (!strcmp(kind, "structs")) {
+    gen_structs(n);
+  } else if (!strcmp(kind, "globals")) {
+    gen_globals(n);
+  } else if (!strcmp(kind, "strings")) {
+    gen_strings(n);
+  } else if (!strcmp(kind, "huge")) {
+    gen_functions(n);
+    gen_exprs(n);
+    gen_structs(n);
+    gen_globals(n);
+    gen_strings(n);
+  } else {
+    fprintf(stderr, "unknown kind: %s\n", kind);
+    return 1;
+  }
+
+  printf("int main() { return 0; }\n");
+  return 0;
+}
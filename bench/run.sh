@@ -0,0 +1,45 @@
+#!/bin/sh
+# Measures the compile throughput of 9cc on synthetic sources generated by
+# bench/gen. For each kind of source, prints the wall-clock time, lines per
+# second and peak RSS of every phase of the compiler.
+#
+# usage: bench/run.sh <9cc> <gen> [scale]
+set -e
+
+CC9=$1
+GEN=$2
+SCALE=${3:-1}
+TMP=${TMPDIR:-/tmp}/9cc-bench.$$
+trap 'rm -f $TMP.c $TMP.s $TMP.stats' EXIT
+
+run() {
+  kind=$1
+  n=$(($2 * SCALE))
+  "$GEN" "$kind" "$n" > $TMP.c
+  lines=$(wc -l < $TMP.c)
+  "$CC9" --stats $TMP.c > $TMP.s 2> $TMP.stats
+
+  printf '%s (n=%d, %d lines)\n' "$kind" "$n" "$lines"
+  awk -v lines="$lines" '
+    function rate(ms) { return ms > 0 ? lines * 1000 / ms : 0 }
+    /^phase/ {
+      printf "  %-16s %12s %14s %14s\n", "phase", "wall (ms)", "lines/s", "peak RSS (KB)"
+      on = 1
+      next
+    }
+    /^total/ {
+      printf "  %-16s %12.3f %14.0f\n", $1, $2, rate($2)
+      on = 0
+      next
+    }
+    on { printf "  %-16s %12.3f %14.0f %14d\n", $1, $2, rate($2), $4 }
+  ' $TMP.stats
+  echo
+}
+
+run functions 2000
+run exprs 5000
+run structs 2000
+run globals 4000
+run strings 2000
+run huge 1000
@@ -0,0 +1,75 @@
+#!/bin/sh
+# Compares the code generated by 9cc with gcc -O0 and -O1 on the programs in
+# bench/runtime. For each program and compiler, prints the best wall-clock
+# time of several runs, the number of retired instructions if perf(1) is
+# available, and the size of the text section of the object file. The output
+# of every build must match that of gcc -O0.
+#
+# usage: bench/runtime.sh <9cc> <cc> [runs]
+set -e
+
+CC9=$1
+CC=$2
+RUNS=${3:-3}
+TMP=${TMPDIR:-/tmp}/9cc-runtime.$$
+trap 'rm -f $TMP.s $TMP.o $TMP.out $TMP.expected $TMP.perf $TMP' EXIT
+
+# Prints the current time in milliseconds.
+now_ms() {
+  echo $(($(date +%s%N) / 1000000))
+}
+
+# Runs the program built as $TMP from $TMP.o and prints a row of the report.
+# 9cc emits position-dependent code, so every build is linked with -no-pie
+# to keep working on toolchains that default to PIE.
+measure() {
+  name=$1
+  compiler=$2
+
+  $CC -no-pie -o $TMP $TMP.o
+  text=$(size -A $TMP.o | awk '$1 == ".text" { print $2 }')
+
+  best=
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    start=$(now_ms)
+    $TMP > $TMP.out
+    elapsed=$(($(now_ms) - start))
+    if [ -z "$best" ] || [ $elapsed -lt "$best" ]; then
+      best=$elapsed
+    fi
+    i=$((i + 1))
+  done
+
+  insns=-
+  if command -v perf > /dev/null &&
+     perf stat -x, -e instructions:u -o $TMP.perf $TMP > /dev/null 2>&1; then
+    insns=$(awk -F, '/instructions/ { print $1 }' $TMP.perf)
+  fi
+
+  status=
+  if [ -f $TMP.expected ] && ! cmp -s $TMP.out $TMP.expected; then
+    status="  WRONG OUTPUT"
+  fi
+  printf '%-10s %-10s %10d %16s %12d%s\n' \
+    "$name" "$compiler" "$best" "$insns" "$text" "$status"
+}
+
+printf '%-10s %-10s %10s %16s %12s\n' \
+  benchmark compiler "time (ms)" instructions "text (bytes)"
+
+for src in bench/runtime/*.c; do
+  name=$(basename $src .c)
+  rm -f $TMP.expected
+
+  gcc -w -O0 -c -o $TMP.o $src
+  measure $name "gcc -O0"
+  cp $TMP.out $TMP.expected
+
+  gcc -w -O1 -c -o $TMP.o $src
+  measure $name "gcc -O1"
+
+  $CC9 $src > $TMP.s
+  $CC -c -o $TMP.o $TMP.s
+  measure $name 9cc
+done
@@ -0,0 +1,93 @@
+// Bytecode interpreter for a small stack machine, dominated by the "switch"
+// dispatching each instruction
+int printf(char *fmt, ...);
+
+// Opcodes, each followed by an operand where noted:
+//   0 halt         1 push imm     2 load reg     3 store reg
+//   4 add          5 sub          6 mul          7 jnz addr     8 jmp addr
+//
+// The program counts r0 down from 10000000 while accumulating
+// r1 = r1 + r0 * 7 - 3, and returns r1.
+long code[40] = {
+    1, 10000000, // push 10000000
+    3, 0,        // store r0
+    1, 0,        // push 0
+    3, 1,        // store r1
+    2, 1,        // 8: load r1
+    2, 0,        // load r0
+    1, 7,        // push 7
+    6,           // mul
+    4,           // add
+    1, 3,        // push 3
+    5,           // sub
+    3, 1,        // store r1
+    2, 0,        // load r0
+    1, 1,        // push 1
+    5,           // sub
+    3, 0,        // store r0
+    2, 0,        // load r0
+    7, 8,        // jnz 8
+    2, 1,        // load r1
+    0,           // halt
+};
+
+long stack[16];
+long regs[4];
+
+long run() {
+  long pc;
+  long sp;
+  pc = 0;
+  sp = 0;
+  for (;;) {
+    switch (code[pc]) {
+    case 0:
+      return stack[sp - 1];
+    case 1:
+      stack[sp] = code[pc + 1];
+      sp = sp + 1;
+      pc = pc + 2;
+      break;
+    case 2:
+      stack[sp] = regs[code[pc + 1]];
+      sp = sp + 1;
+      pc = pc + 2;
+      break;
+    case 3:
+      sp = sp - 1;
+      regs[code[pc + 1]] = stack[sp];
+      pc = pc + 2;
+      break;
+    case 4:
+      sp = sp - 1;
+      stack[sp - 1] = stack[sp - 1] + stack[sp];
+      pc = pc + 1;
+      break;
+    case 5:
+      sp = sp - 1;
+      stack[sp - 1] = stack[sp - 1] - stack[sp];
+      pc = pc + 1;
+      break;
+    case 6:
+      sp = sp - 1;
+      stack[sp - 1] = stack[sp - 1] * stack[sp];
+      pc = pc + 1;
+      break;
+    case 7:
+      sp = sp - 1;
+      if (stack[sp])
+        pc = code[pc + 1];
+      else
+        pc = pc + 2;
+      break;
+    case 8:
+      pc = code[pc + 1];
+      break;
+    }
+  }
+}
+
+int main() {
+  printf("%ld\n", run());
+  return 0;
+}
@@ -0,0 +1,58 @@
+// Traversal of a linked list of structs scattered over an array, dominated
+// by dependent loads and member accesses. Links are array indices since a
+// struct can't refer to its own type.
+int printf(char *fmt, ...);
+
+struct Node {
+  long val;
+  long weight;
+  int next;
+  char tag;
+} pool[100000];
+
+// Links the nodes in a scrambled order and returns the index of the head.
+int build(int n) {
+  int i;
+  int cur;
+  int next;
+  cur = 0;
+  for (i = 0; i < n; i = i + 1) {
+    // 7919 is prime to n, so this visits every node once
+    next = cur + 7919;
+    next = next - next / n * n;
+    if (i == n - 1)
+      next = -1;
+    pool[cur].val = i;
+    pool[cur].weight = i / 3;
+    pool[cur].tag = i;
+    pool[cur].next = next;
+    cur = next;
+  }
+  return 0;
+}
+
+long traverse(int head) {
+  long sum;
+  struct Node *node;
+  sum = 0;
+  while (head >= 0) {
+    node = &pool[head];
+    if (node->tag == 7)
+      sum = sum + node->weight;
+    else
+      sum = sum + node->val;
+    head = node->next;
+  }
+  return sum;
+}
+
+int main() {
+  int i;
+  long sum;
+  build(100000);
+  sum = 0;
+  for (i = 0; i < 200; i = i + 1)
+    sum = sum + traverse(0);
+  printf("%ld\n", sum);
+  return 0;
+}
@@ -0,0 +1,48 @@
+// Multiplication of square matrices, dominated by 2D array indexing
+int printf(char *fmt, ...);
+
+long a[200][200];
+long b[200][200];
+long c[200][200];
+
+int init(int n) {
+  int i;
+  int j;
+  for (i = 0; i < n; i = i + 1) {
+    for (j = 0; j < n; j = j + 1) {
+      a[i][j] = i + j;
+      b[i][j] = i - 2 * j;
+    }
+  }
+  return 0;
+}
+
+int matmul(int n) {
+  int i;
+  int j;
+  int k;
+  long sum;
+  for (i = 0; i < n; i = i + 1) {
+    for (j = 0; j < n; j = j + 1) {
+      sum = 0;
+      for (k = 0; k < n; k = k + 1)
+        sum = sum + a[i][k] * b[k][j];
+      c[i][j] = sum;
+    }
+  }
+  return 0;
+}
+
+int main() {
+  int i;
+  long trace;
+  init(200);
+  for (i = 0; i < 10; i = i + 1)
+    matmul(200);
+
+  trace = 0;
+  for (i = 0; i < 200; i = i + 1)
+    trace = trace + c[i][i];
+  printf("%ld\n", trace);
+  return 0;
+}
@@ -0,0 +1,31 @@
+// Sieve of Eratosthenes over a byte array, dominated by loads and stores
+int printf(char *fmt, ...);
+
+char flags[10000001];
+
+int sieve(int n) {
+  int count;
+  int i;
+  int j;
+  for (i = 2; i <= n; i = i + 1)
+    flags[i] = 1;
+
+  count = 0;
+  for (i = 2; i <= n; i = i + 1) {
+    if (flags[i]) {
+      count = count + 1;
+      for (j = i + i; j <= n; j = j + i)
+        flags[j] = 0;
+    }
+  }
+  return count;
+}
+
+int main() {
+  int count;
+  int i;
+  for (i = 0; i < 2; i = i + 1)
+    count = sieve(10000000);
+  printf("%d\n", count);
+  return 0;
+}
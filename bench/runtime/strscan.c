@@ -0,0 +1,56 @@
+// Counting words and digits in a large text buffer, dominated by byte loads
+// and unpredictable branches
+int printf(char *fmt, ...);
+
+char text[4194305];
+char *pattern = "the quick brown fox 0123 jumps over 42 lazy dogs\n";
+
+int fill(int size) {
+  int i;
+  char *p;
+  p = pattern;
+  for (i = 0; i < size; i = i + 1) {
+    if (*p == 0)
+      p = pattern;
+    text[i] = *p;
+    p = p + 1;
+  }
+  text[size] = 0;
+  return 0;
+}
+
+// Returns the number of words, plus the number of digits times 2^32.
+long scan(char *s) {
+  long words;
+  long digits;
+  int in_word;
+  words = 0;
+  digits = 0;
+  in_word = 0;
+  while (*s) {
+    if (*s == 32) {
+      in_word = 0;
+    } else if (*s == 10) {
+      in_word = 0;
+    } else if (in_word == 0) {
+      in_word = 1;
+      words = words + 1;
+    }
+    if (48 <= *s)
+      if (*s <= 57)
+        digits = digits + 1;
+    s = s + 1;
+  }
+  return words + digits * 4294967296;
+}
+
+int main() {
+  int i;
+  long result;
+  fill(4194304);
+  for (i = 0; i < 10; i = i + 1)
+    result = scan(text);
+  printf("%ld words, %ld digits\n", result - result / 4294967296 * 4294967296,
+         result / 4294967296);
+  return 0;
+}
@@ -1,45 +1,456 @@
 #include "9cc.h"
+#include <unistd.h>
 
 char *arg_regs_1[] = {"dil", "sil", "dl", "cl", "r8b", "r9b"};
+char *arg_regs_2[] = {"di", "si", "dx", "cx", "r8w", "r9w"};
+char *arg_regs_4[] = {"edi", "esi", "edx", "ecx", "r8d", "r9d"};
 char *arg_regs_8[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
 
 // Global sequence number which is used for jump labels
 int label_seq = 1;
-char *func_name;
 
-void store(Type *type) {
-  printf("  pop rdi\n");
-  printf("  pop rax\n");
-  if (type->size == 1) {
-    printf("  mov [rax], dil\n");
+// Function being generated
+Function *current_fn;
+
+// Whether calls in tail position of the current function can reuse or release
+// its stack frame
+bool tail_call_ok;
+
+// If true, the current function sets up no frame pointer and addresses its
+// locals relative to RSP. The CFA then moves with every push and pop.
+bool frameless;
+
+// Number of 8-byte values the stack machine has pushed since the prologue.
+// Since the prologue leaves RSP 16-byte aligned, the parity of `depth` tells
+// whether RSP is aligned at any point of the generated code.
+int depth;
+
+// Label sequence number and stack depth of the innermost inlined call being
+// generated, which ND_INLINE_RET jumps out of.
+int inline_seq;
+int inline_depth;
+
+// Stack depth at which the address of the left operand of the innermost
+// compound assignment being generated was pushed, which ND_LHS_VAL reads.
+int lhs_depth;
+
+// Label sequence number and stack depth of the innermost loop or "switch"
+// being generated, which "break" jumps out of.
+int break_seq;
+int break_depth;
+
+// Branch of an "if" statement which the profile shows is rarely executed. It
+// is generated after the function epilogue, out of the way of the hot path,
+// and jumps back to the end of the statement.
+typedef struct ColdBlock ColdBlock;
+struct ColdBlock {
+  ColdBlock *next;
+  Node *node;
+  int seq;
+  int prof_id; // Profile counter to increment on entry, or 0
+  int depth;
+  int inline_seq;
+  int inline_depth;
+  int break_seq;
+  int break_depth;
+};
+
+ColdBlock *cold_blocks;
+
+// Names of the functions emitted so far
+char **fn_names;
+int n_fns;
+
+// Index of the current function in the tables of -finstrument-functions-lite
+int instr_id;
+
+// Source line of the last .loc directive
+int loc_line;
+
+// Records that RSP has moved down by `n` bytes in the unwind information of
+// a frameless function.
+void adjust_cfa(int n) {
+  if (frameless && n) {
+    printf("  .cfi_adjust_cfa_offset %d\n", n);
+  }
+}
+
+void push(char *arg) {
+  printf("  push %s\n", arg);
+  adjust_cfa(8);
+  depth++;
+}
+
+void pop(char *arg) {
+  printf("  pop %s\n", arg);
+  adjust_cfa(-8);
+  depth--;
+}
+
+// Returns the memory operand of a local variable. Without a frame pointer,
+// the offset from RSP depends on the current stack depth. The result is
+// overwritten by the next call.
+char *local_mem(Var *var) {
+  static char buf[32];
+  if (frameless) {
+    sprintf(buf, "[rsp+%d]", current_fn->stack_size - var->offset + depth * 8);
   } else {
-    printf("  mov [rax], rdi\n");
+    sprintf(buf, "[rbp-%d]", var->offset);
   }
-  printf("  push rdi\n");
+  return buf;
 }
 
+// Discards `n` values from the stack and jumps to the label formatted from
+// `fmt`. In a frameless function, the code following the jump continues with
+// the current depth.
+void gen_jump(int n, char *fmt, ...) {
+  if (n && frameless) {
+    printf("  .cfi_remember_state\n");
+  }
+  if (n) {
+    printf("  add rsp, %d\n", n * 8);
+    adjust_cfa(-n * 8);
+  }
+
+  va_list ap;
+  va_start(ap, fmt);
+  printf("  jmp ");
+  vprintf(fmt, ap);
+  printf("\n");
+  va_end(ap);
+
+  if (n && frameless) {
+    printf("  .cfi_restore_state\n");
+  }
+}
+
+// Copies a struct of `type` from the address in RDI to the address in RAX.
+// Small structs are copied with a few moves of up to 16 bytes, and large ones
+// with "rep movsb", whose startup cost is amortized over many bytes.
+void copy_struct(Type *type) {
+  if (type->size > 64) {
+    printf("  mov rsi, rdi\n");
+    printf("  mov rdi, rax\n");
+    printf("  mov rcx, %d\n", type->size);
+    printf("  rep movsb\n");
+    return;
+  }
+
+  int offset = 0;
+  while (offset + 16 <= type->size) {
+    printf("  movdqu xmm0, [rdi+%d]\n", offset);
+    printf("  movdqu [rax+%d], xmm0\n", offset);
+    offset += 16;
+  }
+
+  static char *regs[] = {"rdx", "edx", "dx", "dl"};
+  for (int i = 0, size = 8; size > 0; i++, size /= 2) {
+    while (offset + size <= type->size) {
+      printf("  mov %s, [rdi+%d]\n", regs[i], offset);
+      printf("  mov [rax+%d], %s\n", offset, regs[i]);
+      offset += size;
+    }
+  }
+}
+
+// Zero-fills `size` bytes at the address in RDI. A large object is filled
+// with "rep stosq", and a small one with 16-byte SSE stores.
+void zero_fill(int size) {
+  int offset = 0;
+  printf("  xor eax, eax\n");
+  if (size > 128) {
+    printf("  mov rcx, %d\n", size / 8);
+    printf("  rep stosq\n");
+    size %= 8;
+  } else if (size >= 16) {
+    printf("  pxor xmm0, xmm0\n");
+    for (; offset + 16 <= size; offset += 16) {
+      printf("  movdqu [rdi+%d], xmm0\n", offset);
+    }
+  }
+
+  static char *regs[] = {"rax", "eax", "ax", "al"};
+  for (int i = 0, n = 8; n > 0; i++, n /= 2) {
+    for (; offset + n <= size; offset += n) {
+      printf("  mov [rdi+%d], %s\n", offset, regs[i]);
+    }
+  }
+}
+
+char *rdi_regs[] = {"dil", "di", "edi", "rdi"};
+char *ptr_sizes[] = {"byte ptr", "word ptr", "dword ptr", "qword ptr"};
+
+// Returns the index of an integer or pointer type in the tables of register
+// and operand sizes.
+int size_index(Type *type) {
+  return type->size == 1 ? 0 : type->size == 2 ? 1 : type->size == 4 ? 2 : 3;
+}
+
+void store(Type *type) {
+  pop("rdi");
+  pop("rax");
+  if (type->kind == TYPE_STRUCT) {
+    copy_struct(type);
+    push("rax");
+    return;
+  }
+  printf("  mov [rax], %s\n", rdi_regs[size_index(type)]);
+  push("rdi");
+}
+
+// Replaces the address at the top of the stack with the value at that
+// address. A struct is represented by its address, so it is left as is.
 void load(Type *type) {
-  printf("  pop rax\n");
+  if (type->kind == TYPE_STRUCT) {
+    return;
+  }
+  pop("rax");
+  char *ext = type->is_unsigned ? "movzx" : "movsx";
   if (type->size == 1) {
-    printf("  movsx rax, byte ptr [rax]\n");
+    printf("  %s rax, byte ptr [rax]\n", ext);
+  } else if (type->size == 2) {
+    printf("  %s rax, word ptr [rax]\n", ext);
+  } else if (type->size == 4 && type->is_unsigned) {
+    printf("  mov eax, [rax]\n");
+  } else if (type->size == 4) {
+    printf("  movsxd rax, dword ptr [rax]\n");
   } else {
     printf("  mov rax, [rax]\n");
   }
-  printf("  push rax\n");
+  push("rax");
+}
+
+// Truncates RAX to an integer type and extends it back to 64 bits, with the
+// sign if the type is signed. Values of every integer type are kept in
+// registers in this form.
+void extend(Type *type) {
+  char *ext = type->is_unsigned ? "movzx" : "movsx";
+  if (type->size == 1) {
+    printf("  %s rax, al\n", ext);
+  } else if (type->size == 2) {
+    printf("  %s rax, ax\n", ext);
+  } else if (type->size == 4 && type->is_unsigned) {
+    printf("  mov eax, eax\n");
+  } else if (type->size == 4) {
+    printf("  movsxd rax, eax\n");
+  }
 }
 
 void gen(Node *node);
 
+// Returns log2(n) if `n` is a power of two, otherwise -1.
+int log2_exact(long n) {
+  if (n <= 0 || (n & (n - 1))) {
+    return -1;
+  }
+  int k = 0;
+  while (n > 1) {
+    n >>= 1;
+    k++;
+  }
+  return k;
+}
+
+// Multiplies `reg` by a constant with shifts or LEA where possible.
+// `val` must fit in 32 bits unless its absolute value is a power of two.
+void mul_imm(char *reg, long val) {
+  long abs = val < 0 ? -val : val;
+  int k = log2_exact(abs);
+
+  if (val == 0) {
+    printf("  xor %s, %s\n", reg, reg);
+    return;
+  }
+
+  if (k > 0) {
+    printf("  shl %s, %d\n", reg, k);
+  } else if (abs == 3 || abs == 5 || abs == 9) {
+    printf("  lea %s, [%s+%s*%ld]\n", reg, reg, reg, abs - 1);
+  } else if (abs != 1) {
+    printf("  imul %s, %s, %ld\n", reg, reg, val);
+    return;
+  }
+
+  if (val < 0) {
+    printf("  neg %s\n", reg);
+  }
+}
+
+// Computes the magic number and the shift amount to divide a signed 64-bit
+// integer by `d` with a multiplication, as described in Hacker's Delight,
+// chapter 10. `d` must not be 0, 1 or -1.
+void div_magic(long d, long *magic, int *shift) {
+  unsigned long two63 = 1UL << 63;
+  unsigned long ad = d < 0 ? -(unsigned long)d : d;
+  unsigned long t = two63 + ((unsigned long)d >> 63);
+  unsigned long anc = t - 1 - t % ad;
+  unsigned long q1 = two63 / anc;
+  unsigned long r1 = two63 - q1 * anc;
+  unsigned long q2 = two63 / ad;
+  unsigned long r2 = two63 - q2 * ad;
+  unsigned long delta;
+  int p = 63;
+
+  do {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+
+  *magic = d < 0 ? -(long)(q2 + 1) : (long)(q2 + 1);
+  *shift = p - 64;
+}
+
+// Divides RAX by a non-zero constant, rounding toward zero like IDIV.
+// RDI and RDX are clobbered.
+void div_imm(long val) {
+  long abs = val < 0 ? -val : val;
+  int k = log2_exact(abs);
+
+  if (abs == 1) {
+    // Nothing to do
+  } else if (k > 0) {
+    // Bias negative dividends by 2^k-1 so that the shift rounds toward zero
+    printf("  mov rdi, rax\n");
+    printf("  sar rdi, 63\n");
+    printf("  shr rdi, %d\n", 64 - k);
+    printf("  add rax, rdi\n");
+    printf("  sar rax, %d\n", k);
+  } else {
+    long magic;
+    int shift;
+    div_magic(val, &magic, &shift);
+
+    printf("  mov rdi, rax\n");
+    printf("  mov rax, %ld\n", magic);
+    printf("  imul rdi\n");
+    if (val > 0 && magic < 0) {
+      printf("  add rdx, rdi\n");
+    } else if (val < 0 && magic > 0) {
+      printf("  sub rdx, rdi\n");
+    }
+    if (shift > 0) {
+      printf("  sar rdx, %d\n", shift);
+    }
+    // Add one to a negative quotient
+    printf("  mov rax, rdx\n");
+    printf("  shr rax, 63\n");
+    printf("  add rax, rdx\n");
+    return;
+  }
+
+  if (val < 0) {
+    printf("  neg rax\n");
+  }
+}
+
+// Divides RAX by a positive constant `val` knowing that RAX is a multiple of
+// it, as is the case for a difference of two pointers.
+void div_exact(long val) {
+  int k = log2_exact(val);
+  if (k >= 0) {
+    if (k > 0) {
+      printf("  sar rax, %d\n", k);
+    }
+    return;
+  }
+  div_imm(val);
+}
+
+// Generates a binary operator whose right operand (or either operand of `*`)
+// is an integer constant, without materializing the constant on the stack.
+// Returns false if the node is not such an operator.
+bool gen_binary_imm(Node *node) {
+  Node *lhs = node->lhs;
+  Node *rhs = node->rhs;
+  if (node->kind == ND_MUL && lhs->kind == ND_NUM) {
+    lhs = node->rhs;
+    rhs = node->lhs;
+  }
+  if (rhs->kind != ND_NUM) {
+    return false;
+  }
+
+  long val = rhs->val;
+  switch (node->kind) {
+  case ND_PTR_ADD:
+  case ND_PTR_SUB:
+    val *= node->type->base->size;
+    if (val != (int)val) {
+      return false;
+    }
+    gen(lhs);
+    pop("rax");
+    printf("  %s rax, %ld\n", node->kind == ND_PTR_ADD ? "add" : "sub", val);
+    break;
+  case ND_MUL:
+    // IMUL takes at most a 32-bit immediate
+    if (val != (int)val && log2_exact(val < 0 ? -val : val) < 0) {
+      return false;
+    }
+    gen(lhs);
+    pop("rax");
+    mul_imm("rax", val);
+    extend(node->type);
+    break;
+  case ND_DIV:
+    // Leave a division by zero to the hardware
+    if (val == 0) {
+      return false;
+    }
+    if (node->type->is_unsigned && node->type->size == 8) {
+      // Only a power of two is easy to divide an unsigned 64-bit value by
+      int k = log2_exact(val);
+      if (k < 0) {
+        return false;
+      }
+      gen(lhs);
+      pop("rax");
+      printf("  shr rax, %d\n", k);
+      break;
+    }
+    gen(lhs);
+    pop("rax");
+    div_imm(val);
+    extend(node->type);
+    break;
+  default:
+    return false;
+  }
+
+  push("rax");
+  return true;
+}
+
 // Pushes the given node's address to the stack.
 void gen_addr(Node *node) {
   switch (node->kind) {
   case ND_VAR: {
     Var *var = node->var;
     if (var->is_local) {
-      printf("  lea rax, [rbp-%d]\n", var->offset);
-      printf("  push rax\n");
+      printf("  lea rax, %s\n", local_mem(var));
+      push("rax");
+    } else if (var->is_extern && pic) {
+      printf("  mov rax, [rip+%s@GOTPCREL]\n", var->name);
+      push("rax");
+    } else if (pic) {
+      printf("  lea rax, [rip+%s]\n", var->name);
+      push("rax");
     } else {
       printf("  push offset %s\n", var->name);
+      adjust_cfa(8);
+      depth++;
     }
     return;
   }
@@ -48,9 +459,9 @@ void gen_addr(Node *node) {
     return;
   case ND_MEMBER:
     gen_addr(node->lhs);
-    printf("  pop rax\n");
+    pop("rax");
     printf("  add rax, %d\n", node->member->offset);
-    printf("  push rax\n");
+    push("rax");
     return;
   default:
     error_tok(node->tok, "not a lvalue");
@@ -64,21 +475,752 @@ void gen_lval(Node *node) {
   gen_addr(node);
 }
 
+// Emits a jump to `label`.`seq` which is taken if the truth value of `cond`
+// equals `when`. A comparison is compiled to a single CMP followed by a
+// conditional jump instead of materializing a boolean and testing it again.
+void gen_branch(Node *cond, bool when, char *label, int seq) {
+  char *jcc;
+  switch (cond->kind) {
+  case ND_EQ:
+    jcc = when ? "je" : "jne";
+    break;
+  case ND_NE:
+    jcc = when ? "jne" : "je";
+    break;
+  case ND_LT:
+    if (is_unsigned_cmp(cond)) {
+      jcc = when ? "jb" : "jae";
+    } else {
+      jcc = when ? "jl" : "jge";
+    }
+    break;
+  case ND_LE:
+    if (is_unsigned_cmp(cond)) {
+      jcc = when ? "jbe" : "ja";
+    } else {
+      jcc = when ? "jle" : "jg";
+    }
+    break;
+  default:
+    gen(cond);
+    pop("rax");
+    printf("  cmp rax, 0\n");
+    printf("  %s %s.%d\n", when ? "jne" : "je", label, seq);
+    return;
+  }
+
+  gen(cond->lhs);
+  if (cond->rhs->kind == ND_NUM && cond->rhs->val == (int)cond->rhs->val) {
+    pop("rax");
+    printf("  cmp rax, %ld\n", cond->rhs->val);
+  } else {
+    gen(cond->rhs);
+    pop("rdi");
+    pop("rax");
+    printf("  cmp rax, rdi\n");
+  }
+  printf("  %s %s.%d\n", jcc, label, seq);
+}
+
+// Increments a profile counter if the program is instrumented.
+void gen_counter(int id) {
+  if (profile_generate && id) {
+    printf("  inc qword ptr [rip+.L.prof.counters+%d]\n", id * 8);
+  }
+}
+
+// Defers a rarely executed branch to the end of the function.
+void add_cold_block(Node *node, int seq, int prof_id) {
+  ColdBlock *cb = calloc(1, sizeof(ColdBlock));
+  cb->node = node;
+  cb->seq = seq;
+  cb->prof_id = prof_id;
+  cb->depth = depth;
+  cb->inline_seq = inline_seq;
+  cb->inline_depth = inline_depth;
+  cb->break_seq = break_seq;
+  cb->break_depth = break_depth;
+  cb->next = cold_blocks;
+  cold_blocks = cb;
+}
+
+// Generates the branches deferred by add_cold_block(). A cold block may
+// defer blocks of its own, which are generated in turn.
+void gen_cold_blocks() {
+  while (cold_blocks) {
+    ColdBlock *cb = cold_blocks;
+    cold_blocks = cb->next;
+    depth = cb->depth;
+    inline_seq = cb->inline_seq;
+    inline_depth = cb->inline_depth;
+    break_seq = cb->break_seq;
+    break_depth = cb->break_depth;
+
+    printf(".L.cold.%d:\n", cb->seq);
+    if (frameless) {
+      printf("  .cfi_def_cfa_offset %d\n",
+             current_fn->stack_size + depth * 8 + 8);
+    }
+    gen_counter(cb->prof_id);
+    gen(cb->node);
+    printf("  jmp .L.end.%d\n", cb->seq);
+  }
+}
+
+// Generates an "if" statement. With a profile, the more frequently executed
+// branch falls through and a rarely executed one is moved out of line.
+void gen_if(Node *node) {
+  int seq = label_seq;
+  label_seq++;
+  gen_counter(node->prof_id);
+
+  if (is_cold_branch(node)) {
+    gen_branch(node->cond, true, ".L.cold", seq);
+    add_cold_block(node->cons, seq, node->prof_id + 1);
+    if (node->alt) {
+      gen(node->alt);
+    }
+    printf(".L.end.%d:\n", seq);
+    return;
+  }
+
+  if (!node->alt) {
+    gen_branch(node->cond, false, ".L.end", seq);
+    gen_counter(node->prof_id + 1);
+    gen(node->cons);
+    printf(".L.end.%d:\n", seq);
+    return;
+  }
+
+  if (is_cold_else(node)) {
+    gen_branch(node->cond, false, ".L.cold", seq);
+    gen_counter(node->prof_id + 1);
+    gen(node->cons);
+    add_cold_block(node->alt, seq, 0);
+  } else if (is_unlikely(node)) {
+    gen_branch(node->cond, true, ".L.then", seq);
+    gen(node->alt);
+    printf("  jmp .L.end.%d\n", seq);
+    printf(".L.then.%d:\n", seq);
+    gen_counter(node->prof_id + 1);
+    gen(node->cons);
+  } else {
+    gen_branch(node->cond, false, ".L.else", seq);
+    gen_counter(node->prof_id + 1);
+    gen(node->cons);
+    printf("  jmp .L.end.%d\n", seq);
+    printf(".L.else.%d:\n", seq);
+    gen(node->alt);
+  }
+  printf(".L.end.%d:\n", seq);
+}
+
+// "case" labels of a "switch" statement
+typedef struct {
+  Node **cases;
+  int len;
+  Node *dflt; // "default" label, or NULL
+} CaseList;
+
+// Collects the labels of a "switch" statement in `node`, which may be nested
+// anywhere in its body except in an inner "switch".
+void collect_cases(Node *node, CaseList *cl) {
+  if (!node || node->kind == ND_SWITCH) {
+    return;
+  }
+
+  if (node->kind == ND_CASE) {
+    if (node->is_default) {
+      cl->dflt = node;
+    } else {
+      cl->cases = realloc(cl->cases, sizeof(Node *) * (cl->len + 1));
+      cl->cases[cl->len++] = node;
+    }
+  }
+
+  collect_cases(node->lhs, cl);
+  collect_cases(node->cons, cl);
+  collect_cases(node->alt, cl);
+  collect_cases(node->init, cl);
+  for (Node *n = node->body; n; n = n->next) {
+    collect_cases(n, cl);
+  }
+}
+
+int compare_cases(const void *a, const void *b) {
+  long x = (*(Node **)a)->val;
+  long y = (*(Node **)b)->val;
+  return x < y ? -1 : x > y;
+}
+
+int compare_cases_unsigned(const void *a, const void *b) {
+  unsigned long x = (*(Node **)a)->val;
+  unsigned long y = (*(Node **)b)->val;
+  return x < y ? -1 : x > y;
+}
+
+// Compares RAX with a constant.
+void gen_cmp_imm(long val) {
+  if (val == (int)val) {
+    printf("  cmp rax, %ld\n", val);
+    return;
+  }
+  printf("  mov rdi, %ld\n", val);
+  printf("  cmp rax, rdi\n");
+}
+
+// Jumps to the label of the case in `cases[lo..hi)`, which are sorted by
+// value, matching RAX, or to label `dflt` if none does. A dense range of
+// values dispatches through a table of label offsets in .rodata. Otherwise
+// the range is split in half with a binary search, and a handful of cases
+// are compared one by one.
+void gen_case_tree(Node **cases, int lo, int hi, int dflt, bool is_unsigned) {
+  int n = hi - lo;
+  if (n == 0) {
+    printf("  jmp .L.case.%d\n", dflt);
+    return;
+  }
+
+  long min = cases[lo]->val;
+  unsigned long range = (unsigned long)cases[hi - 1]->val - min;
+  if (n >= 4 && range < 3 * n) {
+    int seq = label_seq;
+    label_seq++;
+    if (min) {
+      if (min == (int)min) {
+        printf("  sub rax, %ld\n", min);
+      } else {
+        printf("  mov rdi, %ld\n", min);
+        printf("  sub rax, rdi\n");
+      }
+    }
+    printf("  cmp rax, %lu\n", range);
+    printf("  ja .L.case.%d\n", dflt);
+    printf("  lea rdi, [rip+.L.table.%d]\n", seq);
+    printf("  movsxd rax, dword ptr [rdi+rax*4]\n");
+    printf("  add rax, rdi\n");
+    printf("  jmp rax\n");
+
+    printf("  .section .rodata\n");
+    printf("  .align 4\n");
+    printf(".L.table.%d:\n", seq);
+    int i = lo;
+    for (unsigned long v = 0; v <= range; v++) {
+      int label = dflt;
+      if (cases[i]->val - min == v) {
+        label = cases[i]->label;
+        i++;
+      }
+      printf("  .long .L.case.%d-.L.table.%d\n", label, seq);
+    }
+    printf("  .text\n");
+    return;
+  }
+
+  if (n <= 3) {
+    for (int i = lo; i < hi; i++) {
+      gen_cmp_imm(cases[i]->val);
+      printf("  je .L.case.%d\n", cases[i]->label);
+    }
+    printf("  jmp .L.case.%d\n", dflt);
+    return;
+  }
+
+  int mid = lo + n / 2;
+  int seq = label_seq;
+  label_seq++;
+  gen_cmp_imm(cases[mid]->val);
+  printf("  je .L.case.%d\n", cases[mid]->label);
+  printf("  %s .L.lower.%d\n", is_unsigned ? "jb" : "jl", seq);
+  gen_case_tree(cases, mid + 1, hi, dflt, is_unsigned);
+  printf(".L.lower.%d:\n", seq);
+  gen_case_tree(cases, lo, mid, dflt, is_unsigned);
+}
+
+// Generates a "switch" statement. The value is dispatched to the case labels
+// in the body, which is then generated in order so that cases fall through.
+void gen_switch(Node *node) {
+  int seq = label_seq;
+  label_seq++;
+  gen(node->cond);
+  pop("rax");
+
+  CaseList cl = {};
+  collect_cases(node->cons, &cl);
+  for (int i = 0; i < cl.len; i++) {
+    cl.cases[i]->label = label_seq++;
+  }
+  int dflt = label_seq++;
+  if (cl.dflt) {
+    cl.dflt->label = dflt;
+  }
+
+  // Case values have been converted to the promoted type of the value, so
+  // only unsigned long values compare differently from signed ones
+  Type *type = node->cond->type;
+  bool is_unsigned = type->is_unsigned && type->size == 8;
+  qsort(cl.cases, cl.len, sizeof(Node *),
+        is_unsigned ? compare_cases_unsigned : compare_cases);
+  gen_case_tree(cl.cases, 0, cl.len, dflt, is_unsigned);
+  free(cl.cases);
+
+  int saved_seq = break_seq;
+  int saved_depth = break_depth;
+  break_seq = seq;
+  break_depth = depth;
+  gen(node->cons);
+  break_seq = saved_seq;
+  break_depth = saved_depth;
+
+  if (!cl.dflt) {
+    printf(".L.case.%d:\n", dflt);
+  }
+  printf(".L.end.%d:\n", seq);
+}
+
+// Pushes the value of the left operand of a read-modify-write instruction,
+// which is variable `var` or, if it is NULL, at the address in RDX.
+void push_rmw_value(Node *var, Type *type) {
+  if (var) {
+    gen(var);
+    return;
+  }
+  push("rdx");
+  load(type);
+}
+
+// Generates a compound assignment which adds to or subtracts from its left
+// operand as a single read-modify-write instruction on memory, such as
+// "add dword ptr [rbp-4], 1". The value is pushed only if `value_used` is
+// true. Returns false if the assignment is not of that form.
+bool gen_rmw(Node *node, bool value_used) {
+  Type *type = node->lhs->type;
+  if (!is_integer(type) && type->kind != TYPE_PTR) {
+    return false;
+  }
+
+  // Casts only change the upper bits, which the store truncates anyway
+  Node *op = node->rhs;
+  if (op->kind == ND_CAST) {
+    op = op->lhs;
+  }
+  bool is_add = op->kind == ND_ADD || op->kind == ND_PTR_ADD;
+  if (!is_add && op->kind != ND_SUB && op->kind != ND_PTR_SUB) {
+    return false;
+  }
+  Node *lhs = op->lhs;
+  if (lhs->kind == ND_CAST) {
+    lhs = lhs->lhs;
+  }
+  if (lhs->kind != ND_LHS_VAL) {
+    return false;
+  }
+  bool is_ptr = op->kind == ND_PTR_ADD || op->kind == ND_PTR_SUB;
+  int scale = is_ptr ? op->type->base->size : 1;
+
+  // External data is addressed through the GOT in position-independent code
+  Node *var = node->lhs->kind == ND_VAR ? node->lhs : NULL;
+  if (var && var->var->is_extern && pic) {
+    var = NULL;
+  }
+  if (!var) {
+    gen_addr(node->lhs);
+  }
+
+  char operand[32];
+  Node *rhs = op->rhs;
+  if (rhs->kind == ND_NUM && rhs->val * scale == (int)(rhs->val * scale)) {
+    // The store truncates the sum anyway, so does the immediate
+    sprintf(operand, "%ld", extend_const(rhs->val * scale, type));
+  } else {
+    gen(rhs);
+    pop("rdi");
+    if (scale != 1) {
+      mul_imm("rdi", scale);
+    }
+    strcpy(operand, rdi_regs[size_index(type)]);
+  }
+
+  if (!var) {
+    pop("rdx");
+  }
+
+  // A postfix "++" or "--" evaluates to the value before the update
+  bool old_value = value_used && node->is_postfix;
+  if (old_value) {
+    push_rmw_value(var, type);
+  }
+
+  // The operand of a local is relative to RSP in a frameless function, so
+  // it is formatted after the pushes
+  char mem[64];
+  if (var && var->var->is_local) {
+    strcpy(mem, local_mem(var->var));
+  } else if (var) {
+    snprintf(mem, sizeof(mem), "[rip+%s]", var->var->name);
+  } else {
+    strcpy(mem, "[rdx]");
+  }
+  printf("  %s %s %s, %s\n", is_add ? "add" : "sub",
+         ptr_sizes[size_index(type)], mem, operand);
+  if (value_used && !old_value) {
+    push_rmw_value(var, type);
+  }
+  return true;
+}
+
+// Generates a compound assignment. The address of the left operand is
+// computed once and stays on the stack while the new value is computed,
+// reading the old value through ND_LHS_VAL.
+void gen_op_assign(Node *node) {
+  if (gen_rmw(node, true)) {
+    return;
+  }
+
+  gen_lval(node->lhs);
+  int saved_depth = lhs_depth;
+  lhs_depth = depth;
+  if (node->is_postfix) {
+    printf("  mov rax, [rsp]\n");
+    push("rax");
+    load(node->type);
+  }
+  gen(node->rhs);
+  lhs_depth = saved_depth;
+
+  if (!node->is_postfix) {
+    store(node->type);
+    return;
+  }
+
+  // A postfix "++" or "--" evaluates to the old value
+  pop("rdi");
+  pop("rdx");
+  pop("rax");
+  printf("  mov [rax], %s\n", rdi_regs[size_index(node->type)]);
+  push("rdx");
+}
+
+// Reads the time stamp counter into RAX. RDX is clobbered.
+void gen_rdtsc() {
+  printf("  rdtsc\n");
+  printf("  shl rdx, 32\n");
+  printf("  or rax, rdx\n");
+}
+
+// Counts a call to the current function and records the time stamp at which
+// it was entered in the bottom slot of the frame. RDX holds an argument here,
+// so it is saved to R11.
+void gen_instr_enter() {
+  printf("  mov r11, rdx\n");
+  gen_rdtsc();
+  printf("  mov [rbp-%d], rax\n", current_fn->stack_size);
+  printf("  mov rdx, r11\n");
+  printf("  inc qword ptr [rip+.L.instr.counters+%d]\n", instr_id * 16);
+}
+
+// Adds the cycles spent since the current function was entered to its
+// counter. RAX and RDX, which hold a return value or an argument of a tail
+// call here, are preserved.
+void gen_instr_leave() {
+  printf("  mov r10, rax\n");
+  printf("  mov r11, rdx\n");
+  gen_rdtsc();
+  printf("  sub rax, [rbp-%d]\n", current_fn->stack_size);
+  printf("  add [rip+.L.instr.counters+%d], rax\n", instr_id * 16 + 8);
+  printf("  mov rax, r10\n");
+  printf("  mov rdx, r11\n");
+}
+
+// Releases the stack frame before a "ret" or a jump to another function.
+// From here the CFA is RSP-based, so the CFI state of the function body is
+// saved, and the caller restores it after the jump for any code following.
+void gen_leave() {
+  if (frameless) {
+    printf("  .cfi_remember_state\n");
+    if (current_fn->stack_size) {
+      printf("  add rsp, %d\n", current_fn->stack_size);
+      printf("  .cfi_def_cfa_offset 8\n");
+    }
+    return;
+  }
+  printf("  mov rsp, rbp\n");
+  printf("  .cfi_remember_state\n");
+  printf("  pop rbp\n");
+  printf("  .cfi_def_cfa rsp, 8\n");
+}
+
+// Emits a line number for the code generated for a node.
+void gen_loc(Token *tok) {
+  if (debug_info && tok && tok->line_no != loc_line) {
+    printf("  .loc 1 %d\n", tok->line_no);
+    loc_line = tok->line_no;
+  }
+}
+
+// Returns true if a call in a "return" statement can be compiled as a jump.
+bool is_tail_call(Node *node) {
+  if (!tail_call_ok) {
+    return false;
+  }
+
+  int n_args = 0;
+  for (Node *arg = node->args; arg; arg = arg->next) {
+    n_args++;
+  }
+  if (n_args > 6) {
+    return false;
+  }
+
+  // A char returned by the callee would need to be sign-extended
+  if (node->type->size != 8 &&
+      node->type->size != current_fn->return_type->size) {
+    return false;
+  }
+
+  if (!strcmp(node->func_name, current_fn->name)) {
+    return n_args == current_fn->n_params;
+  }
+  return true;
+}
+
+// Returns the suffix of the symbol of a function to be called. In
+// position-independent code, calls to functions which may be defined in or
+// interposed by another module go through the PLT.
+char *plt(bool is_static) {
+  return pic && !is_static ? "@PLT" : "";
+}
+
+// Returns true if the function called by `node` is static.
+bool is_static_call(Node *node) {
+  return node->func && node->func->is_static;
+}
+
+// Loads the address of `stderr` in libc into `reg`, through the GOT in
+// position-independent code.
+void load_stderr(char *reg) {
+  if (pic) {
+    printf("  mov rax, [rip+stderr@GOTPCREL]\n");
+    printf("  mov %s, [rax]\n", reg);
+  } else {
+    printf("  mov %s, [rip+stderr]\n", reg);
+  }
+}
+
+// Generates a call in tail position. A self-recursive call jumps back to the
+// top of the function body, which stores the new arguments to the parameters
+// and reuses the frame. Other calls release the frame and jump to the callee,
+// which then returns directly to our caller.
+void gen_tail_call(Node *node) {
+  int n_args = 0;
+  for (Node *arg = node->args; arg; arg = arg->next) {
+    gen(arg);
+    n_args++;
+  }
+  for (int i = n_args - 1; i >= 0; i--) {
+    pop(arg_regs_8[i]);
+  }
+
+  if (!strcmp(node->func_name, current_fn->name)) {
+    if (depth) {
+      printf("  lea rsp, [rbp-%d]\n", current_fn->stack_size);
+    }
+    printf("  jmp .L.body.%s\n", current_fn->name);
+    return;
+  }
+
+  if (instrument_functions) {
+    gen_instr_leave();
+  }
+  gen_leave();
+  if (!node->func || node->func->is_variadic) {
+    printf("  mov eax, 0\n");
+  }
+  printf("  jmp %s%s\n", node->func_name, plt(is_static_call(node)));
+  printf("  .cfi_restore_state\n");
+}
+
+// Returns the name of the n-th vector register.
+char *vreg(int n) {
+  static char *xmm[] = {"xmm0", "xmm1", "xmm2", "xmm3"};
+  static char *ymm[] = {"ymm0", "ymm1", "ymm2", "ymm3"};
+  return use_avx2 ? ymm[n] : xmm[n];
+}
+
+// Returns the suffix of packed integer instructions for `size`-byte elements.
+char vsuffix(int size) {
+  switch (size) {
+  case 1:
+    return 'b';
+  case 2:
+    return 'w';
+  case 4:
+    return 'd';
+  default:
+    return 'q';
+  }
+}
+
+// Broadcasts the low `size` bytes of a general-purpose register to every
+// element of vector register `n`.
+void broadcast(char *reg, int n, int size) {
+  char *x = vreg(n);
+  if (use_avx2) {
+    printf("  vmovq xmm%d, %s\n", n, reg);
+    printf("  vpbroadcast%c %s, xmm%d\n", vsuffix(size), x, n);
+    return;
+  }
+
+  printf("  movq %s, %s\n", x, reg);
+  if (size == 1) {
+    printf("  punpcklbw %s, %s\n", x, x);
+  }
+  if (size <= 2) {
+    printf("  pshuflw %s, %s, 0\n", x, x);
+  }
+  if (size == 4) {
+    printf("  pshufd %s, %s, 0\n", x, x);
+  } else {
+    printf("  punpcklqdq %s, %s\n", x, x);
+  }
+}
+
+// Generates a loop vectorized by vectorize_loop(). It computes
+// dst[iv..iv+w) = a[iv..iv+w) op b[iv..iv+w) while iv + w <= n, where `w` is
+// the number of elements in a vector register, and leaves the remaining
+// elements to the scalar loop following it.
+void gen_vloop(Node *node) {
+  int seq = label_seq;
+  label_seq++;
+
+  Node *assign = node->lhs;
+  Node *dst = assign->lhs;
+  Node *val = assign->rhs;
+  if (val->kind == ND_CAST) {
+    // Truncation to the element type is implicit in vector arithmetic
+    val = val->lhs;
+  }
+  int size = dst->type->size;
+  int width = use_avx2 ? 32 : 16;
+  char *mov = use_avx2 ? "vmovdqu" : "movdqu";
+
+  Node *ops[2];
+  int n_ops = 0;
+  if (val->kind == ND_ADD || val->kind == ND_SUB) {
+    ops[n_ops++] = val->lhs;
+    ops[n_ops++] = val->rhs;
+  } else {
+    ops[n_ops++] = val;
+  }
+
+  // Compute the array bases and the loop invariants
+  static char *regs[] = {"rsi", "rdx"};
+  gen(dst->lhs->lhs);
+  for (int i = 0; i < n_ops; i++) {
+    gen(ops[i]->kind == ND_DEREF ? ops[i]->lhs->lhs : ops[i]);
+  }
+  gen(node->cond->rhs);
+  pop("r8");
+  for (int i = n_ops - 1; i >= 0; i--) {
+    pop(regs[i]);
+  }
+  pop("rdi");
+  bool is_long = node->var->type->size == 8;
+  printf("  %s rcx, %s %s\n", is_long ? "mov" : "movsxd",
+         is_long ? "qword ptr" : "dword ptr", local_mem(node->var));
+
+  // If the destination overlaps a source a few bytes after it, an element
+  // stored in an iteration of the scalar loop is loaded in a later one, so
+  // the loads can't be done in bulk.
+  for (int i = 0; i < n_ops; i++) {
+    if (ops[i]->kind == ND_DEREF) {
+      printf("  mov rax, rdi\n");
+      printf("  sub rax, %s\n", regs[i]);
+      printf("  sub rax, 1\n");
+      printf("  cmp rax, %d\n", width - 1);
+      printf("  jb .L.vend.%d\n", seq);
+    } else {
+      broadcast(regs[i], i + 2, size);
+    }
+  }
+
+  printf("  jmp .L.vcond.%d\n", seq);
+  printf(".L.vbegin.%d:\n", seq);
+  char *src[2];
+  for (int i = 0; i < n_ops; i++) {
+    if (ops[i]->kind == ND_DEREF) {
+      src[i] = vreg(i);
+      printf("  %s %s, [%s+rcx*%d]\n", mov, src[i], regs[i], size);
+    } else {
+      src[i] = vreg(i + 2);
+    }
+  }
+  if (n_ops == 2) {
+    char *insn = val->kind == ND_ADD ? "padd" : "psub";
+    char suffix = vsuffix(size);
+    if (use_avx2) {
+      printf("  v%s%c ymm0, %s, %s\n", insn, suffix, src[0], src[1]);
+    } else {
+      if (src[0] != vreg(0)) {
+        printf("  movdqa xmm0, %s\n", src[0]);
+      }
+      printf("  %s%c xmm0, %s\n", insn, suffix, src[1]);
+    }
+    src[0] = vreg(0);
+  }
+  printf("  %s [rdi+rcx*%d], %s\n", mov, size, src[0]);
+  printf("  mov rcx, rax\n");
+  printf(".L.vcond.%d:\n", seq);
+  printf("  lea rax, [rcx+%d]\n", width / size);
+  printf("  cmp rax, r8\n");
+  printf("  jle .L.vbegin.%d\n", seq);
+  printf(".L.vend.%d:\n", seq);
+  printf("  mov %s, %s\n", local_mem(node->var), is_long ? "rcx" : "ecx");
+  if (use_avx2) {
+    printf("  vzeroupper\n");
+  }
+}
+
 // Generate code for a given node.
 void gen(Node *node) {
+  gen_loc(node->tok);
+
   switch (node->kind) {
   case ND_NULL:
     return;
   case ND_NUM:
-    // Push the value to the top of the stack
+    // Push the value to the top of the stack. PUSH only takes a 32-bit
+    // immediate, so a larger value goes through RAX.
+    if (node->val != (int)node->val) {
+      printf("  mov rax, %ld\n", node->val);
+      push("rax");
+      return;
+    }
     printf("  push %ld\n", node->val);
+    adjust_cfa(8);
+    depth++;
     return;
   case ND_EXPR_STMT:
+    // A compound assignment whose value is unused may update memory in place
+    if (node->lhs->kind == ND_OP_ASSIGN && gen_rmw(node->lhs, false)) {
+      return;
+    }
     gen(node->lhs);
     // Discard the result value at the top of the stack
     printf("  add rsp, 8\n");
+    adjust_cfa(-8);
+    depth--;
     return;
   case ND_VAR:
+    if (node->var->reg) {
+      push(node->var->reg);
+      return;
+    }
+    gen_addr(node);
+    if (node->type->kind != TYPE_ARRAY) {
+      load(node->type);
+    }
+    return;
   case ND_MEMBER:
     gen_addr(node);
     if (node->type->kind != TYPE_ARRAY) {
@@ -90,6 +1232,14 @@ void gen(Node *node) {
     gen(node->rhs);
     store(node->type);
     return;
+  case ND_OP_ASSIGN:
+    gen_op_assign(node);
+    return;
+  case ND_LHS_VAL:
+    printf("  mov rax, [rsp+%d]\n", (depth - lhs_depth) * 8);
+    push("rax");
+    load(node->type);
+    return;
   case ND_ADDR:
     gen_addr(node->lhs);
     return;
@@ -99,35 +1249,27 @@ void gen(Node *node) {
       load(node->type);
     }
     return;
-  case ND_IF: {
-    int seq = label_seq;
-    label_seq++;
-    gen(node->cond);
-    printf("  pop rax\n");
-    printf("  cmp rax, 0\n");
-    if (node->alt) {
-      printf("  je .L.else.%d\n", seq);
-      gen(node->cons);
-      printf("  jmp .L.end.%d\n", seq);
-      printf(".L.else.%d:\n", seq);
-      gen(node->alt);
-    } else {
-      printf("  je .L.end.%d\n", seq);
-      gen(node->cons);
-    }
-    printf(".L.end.%d:\n", seq);
+  case ND_IF:
+    gen_if(node);
     return;
-  }
   case ND_WHILE: {
+    // Loops are laid out with the condition at the bottom so that each
+    // iteration takes only one branch.
     int seq = label_seq;
     label_seq++;
+    int saved_seq = break_seq;
+    int saved_depth = break_depth;
+    break_seq = seq;
+    break_depth = depth;
+    printf("  jmp .L.cond.%d\n", seq);
     printf(".L.begin.%d:\n", seq);
-    gen(node->cond);
-    printf("  pop rax\n");
-    printf("  cmp rax, 0\n");
-    printf("  je .L.end.%d\n", seq);
+    gen_counter(node->prof_id + 1);
     gen(node->cons);
-    printf("  jmp .L.begin.%d\n", seq);
+    break_seq = saved_seq;
+    break_depth = saved_depth;
+    printf(".L.cond.%d:\n", seq);
+    gen_counter(node->prof_id);
+    gen_branch(node->cond, true, ".L.begin", seq);
     printf(".L.end.%d:\n", seq);
     return;
   }
@@ -137,27 +1279,62 @@ void gen(Node *node) {
     if (node->init) {
       gen(node->init);
     }
-    printf(".L.begin.%d:\n", seq);
     if (node->cond) {
-      gen(node->cond);
-      printf("  pop rax\n");
-      printf("  cmp rax, 0\n");
-      printf("  je .L.end.%d\n", seq);
+      printf("  jmp .L.cond.%d\n", seq);
     }
+    printf(".L.begin.%d:\n", seq);
+    gen_counter(node->prof_id + 1);
+    int saved_seq = break_seq;
+    int saved_depth = break_depth;
+    break_seq = seq;
+    break_depth = depth;
     gen(node->cons);
+    break_seq = saved_seq;
+    break_depth = saved_depth;
     if (node->updt) {
       gen(node->updt);
     }
-    printf("  jmp .L.begin.%d\n", seq);
+    printf(".L.cond.%d:\n", seq);
+    gen_counter(node->prof_id);
+    if (node->cond) {
+      gen_branch(node->cond, true, ".L.begin", seq);
+    } else {
+      printf("  jmp .L.begin.%d\n", seq);
+    }
     printf(".L.end.%d:\n", seq);
     return;
   }
+  case ND_SWITCH:
+    gen_switch(node);
+    return;
+  case ND_CASE:
+    printf(".L.case.%d:\n", node->label);
+    gen(node->lhs);
+    return;
+  case ND_BREAK:
+    // Discard values pushed by enclosing expressions in the loop body
+    gen_jump(depth - break_depth, ".L.end.%d", break_seq);
+    return;
   case ND_BLOCK:
   case ND_STMT_EXPR:
     for (Node *n = node->body; n; n = n->next) {
       gen(n);
     }
     return;
+  case ND_VLOOP:
+    gen_vloop(node);
+    return;
+  case ND_CAST:
+    gen(node->lhs);
+    pop("rax");
+    extend(node->type);
+    push("rax");
+    return;
+  case ND_MEMZERO:
+    gen_addr(node->lhs);
+    pop("rdi");
+    zero_fill(node->lhs->type->size);
+    return;
   case ND_CALL: {
     // Push arguments onto the stack
     int n_args = 0;
@@ -168,34 +1345,79 @@ void gen(Node *node) {
 
     // Set arguments in reverse order
     for (int i = n_args - 1; i >= 0; i--) {
-      printf("  pop %s\n", arg_regs_8[i]);
+      pop(arg_regs_8[i]);
     }
 
     // According to x86-64 ABI, RSP must be aligned to a 16 byte boundary before
-    // calling a function.
-    // RAX is set to zero for a variadic function.
+    // calling a function. The number of pending pushes is known statically, so
+    // the padding is decided here rather than at runtime.
+    bool pad = depth % 2;
+    if (pad) {
+      printf("  sub rsp, 8\n");
+    }
+
+    // AL holds the number of vector registers used by a variadic call. Callees
+    // without a prototype may be variadic, so they are treated the same way.
+    if (!node->func || node->func->is_variadic) {
+      printf("  mov eax, 0\n");
+    }
+    printf("  call %s%s\n", node->func_name, plt(is_static_call(node)));
+
+    if (pad) {
+      printf("  add rsp, 8\n");
+    }
+    // The callee may leave garbage in the upper bits of a narrow return value
+    if (is_integer(node->type)) {
+      extend(node->type);
+    }
+    push("rax");
+
+    return;
+  }
+  case ND_INLINE: {
     int seq = label_seq;
     label_seq++;
-    printf("  mov rax, rsp\n");
-    printf("  and rax, 15\n");
-    printf("  jnz .L.call.%d\n", seq);
-    printf("  mov rax, 0\n");
-    printf("  call %s\n", node->func_name);
-    printf("  jmp .L.end.%d\n", seq);
-    printf(".L.call.%d:\n", seq);
-    printf("  sub rsp, 8\n");
-    printf("  mov rax, 0\n");
-    printf("  call %s\n", node->func_name);
-    printf("  add rsp, 8\n");
-    printf(".L.end.%d:\n", seq);
-    printf("  push rax\n");
+    int saved_seq = inline_seq;
+    int saved_depth = inline_depth;
+    inline_seq = seq;
+    inline_depth = depth;
+    gen_counter(node->func->prof_id);
+
+    for (Node *n = node->body; n; n = n->next) {
+      // A trailing "return" falls through to the end of the inlined body
+      if (!n->next && n->kind == ND_INLINE_RET) {
+        gen(n->lhs);
+        pop("rax");
+        break;
+      }
+      gen(n);
+    }
 
+    printf(".L.inline.%d:\n", seq);
+    if (is_integer(node->type)) {
+      extend(node->type);
+    }
+    push("rax");
+
+    inline_seq = saved_seq;
+    inline_depth = saved_depth;
     return;
   }
+  case ND_INLINE_RET:
+    gen(node->lhs);
+    pop("rax");
+    // Discard values pushed by enclosing expressions in the inlined body
+    gen_jump(depth - inline_depth, ".L.inline.%d", inline_seq);
+    return;
   case ND_RETURN:
+    if (node->lhs->kind == ND_CALL && is_tail_call(node->lhs)) {
+      gen_tail_call(node->lhs);
+      return;
+    }
     gen(node->lhs);
-    printf("  pop rax\n");
-    printf("  jmp .L.return.%s\n", func_name);
+    pop("rax");
+    // The epilogue of a frameless function releases only the locals
+    gen_jump(frameless ? depth : 0, ".L.return.%s", current_fn->name);
     return;
   default:
     // This section is meaningless but added to suppress -Wswitch compiler
@@ -203,39 +1425,53 @@ void gen(Node *node) {
     break;
   }
 
+  if (gen_binary_imm(node)) {
+    return;
+  }
+
   gen(node->lhs);
   gen(node->rhs);
 
-  printf("  pop rdi\n");
-  printf("  pop rax\n");
+  pop("rdi");
+  pop("rax");
 
+  bool is_unsigned = node->type->is_unsigned;
   switch (node->kind) {
   case ND_ADD:
     printf("  add rax, rdi\n");
+    extend(node->type);
     break;
   case ND_PTR_ADD:
-    printf("  imul rdi, %d\n", node->type->base->size);
+    mul_imm("rdi", node->type->base->size);
     printf("  add rax, rdi\n");
     break;
   case ND_SUB:
     printf("  sub rax, rdi\n");
+    extend(node->type);
     break;
   case ND_PTR_SUB:
-    printf("  imul rdi, %d\n", node->type->base->size);
+    mul_imm("rdi", node->type->base->size);
     printf("  sub rax, rdi\n");
     break;
   case ND_PTR_DIFF:
     printf("  sub rax, rdi\n");
-    printf("  cqo\n");
-    printf("  mov rdi, %d\n", node->lhs->type->size);
-    printf("  idiv rdi\n");
+    div_exact(node->lhs->type->base->size);
     break;
   case ND_MUL:
     printf("  imul rax, rdi\n");
+    extend(node->type);
     break;
   case ND_DIV:
-    printf("  cqo\n");
-    printf("  idiv rdi\n");
+    // Unsigned 32-bit values are non-negative as 64-bit signed integers, so
+    // only unsigned long needs an unsigned division.
+    if (is_unsigned && node->type->size == 8) {
+      printf("  xor edx, edx\n");
+      printf("  div rdi\n");
+    } else {
+      printf("  cqo\n");
+      printf("  idiv rdi\n");
+    }
+    extend(node->type);
     break;
   case ND_EQ:
     printf("  cmp rax, rdi\n");
@@ -249,58 +1485,308 @@ void gen(Node *node) {
     break;
   case ND_LT:
     printf("  cmp rax, rdi\n");
-    printf("  setl al\n");
+    printf("  %s al\n", is_unsigned_cmp(node) ? "setb" : "setl");
     printf("  movzx rax, al\n");
     break;
   case ND_LE:
     printf("  cmp rax, rdi\n");
-    printf("  setle al\n");
+    printf("  %s al\n", is_unsigned_cmp(node) ? "setbe" : "setle");
     printf("  movzx rax, al\n");
     break;
   default:
     fprintf(stderr, "unexpected node kind: %d", node->kind);
   }
 
-  printf("  push rax\n");
+  push("rax");
 }
 
+// Stores an argument to its parameter, or moves it to the register of a
+// parameter kept in one, extending it as a load from memory would.
 void load_arg(Var *var, int idx) {
-  char *reg = var->type->size == 1 ? arg_regs_1[idx] : arg_regs_8[idx];
-  printf("  mov [rbp-%d], %s\n", var->offset, reg);
+  Type *type = var->type;
+  if (var->reg && type->size == 8) {
+    if (strcmp(var->reg, arg_regs_8[idx])) {
+      printf("  mov %s, %s\n", var->reg, arg_regs_8[idx]);
+    }
+    return;
+  }
+  if (var->reg && type->size == 4) {
+    if (type->is_unsigned) {
+      printf("  mov %sd, %s\n", var->reg, arg_regs_4[idx]);
+    } else {
+      printf("  movsxd %s, %s\n", var->reg, arg_regs_4[idx]);
+    }
+    return;
+  }
+  if (var->reg) {
+    char **regs = type->size == 1 ? arg_regs_1 : arg_regs_2;
+    printf("  %s %s, %s\n", type->is_unsigned ? "movzx" : "movsx", var->reg,
+           regs[idx]);
+    return;
+  }
+
+  char *reg;
+  if (var->type->size == 1) {
+    reg = arg_regs_1[idx];
+  } else if (var->type->size == 2) {
+    reg = arg_regs_2[idx];
+  } else if (var->type->size == 4) {
+    reg = arg_regs_4[idx];
+  } else {
+    reg = arg_regs_8[idx];
+  }
+  printf("  mov %s, %s\n", local_mem(var), reg);
 }
 
-// Emits text segment.
-void emit_text(Program *prog) {
-  printf(".text\n");
+// Loads the arguments in reverse order, so that the sixth argument is taken
+// out of R9 before the register is given to another parameter.
+void load_args(VarList *params, int idx) {
+  if (params) {
+    load_args(params->next, idx + 1);
+    load_arg(params->var, idx);
+  }
+}
 
-  for (Function *fn = prog->fns; fn; fn = fn->next) {
+// Emits the code of a function to the text segment.
+void emit_function(Function *fn) {
+  fn_names = realloc(fn_names, sizeof(char *) * (n_fns + 1));
+  fn_names[n_fns] = fn->name;
+  instr_id = n_fns++;
+
+  if (!fn->is_static) {
     printf(".global %s\n", fn->name);
-    printf("%s:\n", fn->name);
-    func_name = fn->name;
+  }
+  printf(".type %s, @function\n", fn->name);
+  printf("%s:\n", fn->name);
+  printf("  .cfi_startproc\n");
+  loc_line = 0;
+  gen_loc(fn->tok);
+  current_fn = fn;
+  tail_call_ok = true;
+  for (Node *node = fn->node; node; node = node->next) {
+    if (may_escape_local(node)) {
+      tail_call_ok = false;
+    }
+  }
 
-    // Prologue
+  // Prologue. An instrumented function keeps its entry time stamp in an
+  // extra slot below the local variables. A leaf function needs no frame
+  // pointer, since it has no calls to align the stack for and its locals are
+  // at known offsets from RSP.
+  if (instrument_functions) {
+    fn->stack_size += 16;
+  }
+  depth = 0;
+  frameless = fn->is_leaf && omit_frame_pointer && !instrument_functions;
+  if (frameless) {
+    if (fn->stack_size) {
+      printf("  sub rsp, %d\n", fn->stack_size);
+      printf("  .cfi_def_cfa_offset %d\n", fn->stack_size + 8);
+    }
+  } else {
     printf("  push rbp\n");
+    printf("  .cfi_def_cfa_offset 16\n");
+    printf("  .cfi_offset rbp, -16\n");
     printf("  mov rbp, rsp\n");
+    printf("  .cfi_def_cfa_register rbp\n");
     printf("  sub rsp, %d\n", fn->stack_size);
+  }
+  gen_counter(fn->prof_id);
+  if (instrument_functions) {
+    gen_instr_enter();
+  }
 
-    // Push arguments onto the stack
-    int i = 0;
-    for (VarList *vl = fn->params; vl; vl = vl->next) {
-      load_arg(vl->var, i);
-      i++;
-    }
+  // Self-recursive tail calls jump back here with arguments in registers
+  printf(".L.body.%s:\n", fn->name);
 
-    // Emit assembly code of function body statements
-    for (Node *node = fn->node; node; node = node->next) {
-      gen(node);
+  load_args(fn->params, 0);
+
+  // Emit assembly code of function body statements
+  for (Node *node = fn->node; node; node = node->next) {
+    gen(node);
+  }
+  if (depth != 0) {
+    error("%s: stack depth is %d at the end of the function", fn->name, depth);
+  }
+
+  // Epilogue
+  printf(".L.return.%s:\n", fn->name);
+  if (instrument_functions) {
+    gen_instr_leave();
+  }
+  gen_leave();
+  printf("  ret\n");
+  printf("  .cfi_restore_state\n");
+
+  gen_cold_blocks();
+  printf("  .cfi_endproc\n");
+  printf(".size %s, .-%s\n", fn->name, fn->name);
+}
+
+// Prints a string as a quoted assembler string literal.
+void print_quoted(char *s) {
+  printf("\"");
+  for (char *p = s; *p; p++) {
+    if (*p == '"' || *p == '\\') {
+      printf("\\");
     }
+    printf("%c", *p);
+  }
+  printf("\"");
+}
+
+// Emits a DWARF compilation unit covering the functions in the text segment,
+// which debuggers and profilers need in order to find the line number table.
+// The assembler generates the table itself from the .loc directives.
+void emit_debug_info() {
+  char cwd[4096];
+  if (!getcwd(cwd, sizeof(cwd))) {
+    cwd[0] = '\0';
+  }
+
+  printf(".section .debug_abbrev,\"\",@progbits\n");
+  printf(".L.debug.abbrev:\n");
+  printf("  .uleb128 1\n");    // Abbreviation code
+  printf("  .uleb128 0x11\n"); // DW_TAG_compile_unit
+  printf("  .byte 0\n");       // DW_CHILDREN_no
+  printf("  .uleb128 0x25\n"); // DW_AT_producer
+  printf("  .uleb128 0x8\n");  // DW_FORM_string
+  printf("  .uleb128 0x13\n"); // DW_AT_language
+  printf("  .uleb128 0xb\n");  // DW_FORM_data1
+  printf("  .uleb128 0x3\n");  // DW_AT_name
+  printf("  .uleb128 0x8\n");  // DW_FORM_string
+  printf("  .uleb128 0x1b\n"); // DW_AT_comp_dir
+  printf("  .uleb128 0x8\n");  // DW_FORM_string
+  printf("  .uleb128 0x11\n"); // DW_AT_low_pc
+  printf("  .uleb128 0x1\n");  // DW_FORM_addr
+  printf("  .uleb128 0x12\n"); // DW_AT_high_pc
+  printf("  .uleb128 0x7\n");  // DW_FORM_data8
+  printf("  .uleb128 0x10\n"); // DW_AT_stmt_list
+  printf("  .uleb128 0x17\n"); // DW_FORM_sec_offset
+  printf("  .byte 0\n");
+  printf("  .byte 0\n");
+  printf("  .byte 0\n");
+
+  printf(".section .debug_info,\"\",@progbits\n");
+  printf("  .long .L.debug.info.end-.L.debug.info.begin\n");
+  printf(".L.debug.info.begin:\n");
+  printf("  .short 4\n"); // DWARF version
+  printf("  .long .L.debug.abbrev\n");
+  printf("  .byte 8\n"); // Address size
+  printf("  .uleb128 1\n");
+  printf("  .string \"9cc\"\n");
+  printf("  .byte 0xc\n"); // DW_LANG_C99
+  printf("  .string ");
+  print_quoted(filename);
+  printf("\n  .string ");
+  print_quoted(cwd);
+  printf("\n  .quad .L.text.begin\n");
+  printf("  .quad .L.text.end-.L.text.begin\n");
+  printf("  .long .L.debug.line\n");
+  printf(".L.debug.info.end:\n");
+
+  printf(".section .debug_line,\"\",@progbits\n");
+  printf(".L.debug.line:\n");
+}
 
-    // Epilogue
-    printf(".L.return.%s:\n", func_name);
-    printf("  mov rsp, rbp\n");
-    printf("  pop rbp\n");
-    printf("  ret\n");
+// Emits the profile counters of an instrumented program and a destructor
+// which writes them to the profile file, one per line, when it exits. The
+// counts of earlier runs are added to them if the file holds exactly as many
+// counters, so that several training runs accumulate into one profile.
+void emit_profile() {
+  printf(".data\n");
+  printf(".L.prof.counters:\n");
+  printf("  .zero %d\n", n_prof_counters * 8);
+  printf(".L.prof.old:\n");
+  printf("  .zero %d\n", (n_prof_counters + 1) * 8);
+  printf(".L.prof.path:\n");
+  for (char *p = profile_generate; *p; p++) {
+    printf("  .byte %d\n", *p);
   }
+  printf("  .byte 0\n");
+  printf(".L.prof.read_mode:\n");
+  printf("  .string \"r\"\n");
+  printf(".L.prof.mode:\n");
+  printf("  .string \"w\"\n");
+  printf(".L.prof.fmt:\n");
+  printf("  .string \"%%ld\\n\"\n");
+
+  printf(".section .fini_array,\"aw\"\n");
+  printf("  .quad .L.prof.dump\n");
+
+  printf(".text\n");
+  printf(".L.prof.dump:\n");
+  printf("  .cfi_startproc\n");
+  printf("  push rbx\n");
+  printf("  .cfi_adjust_cfa_offset 8\n");
+  printf("  push r12\n");
+  printf("  .cfi_adjust_cfa_offset 8\n");
+  printf("  push r13\n");
+  printf("  .cfi_adjust_cfa_offset 8\n");
+  printf("  inc qword ptr [rip+.L.prof.counters]\n");
+
+  // Read the previous profile, trying one counter more than expected to
+  // detect a profile of a different program
+  printf("  lea rdi, [rip+.L.prof.path]\n");
+  printf("  lea rsi, [rip+.L.prof.read_mode]\n");
+  printf("  call fopen%s\n", plt(false));
+  printf("  test rax, rax\n");
+  printf("  je .L.prof.write\n");
+  printf("  mov rbx, rax\n");
+  printf("  lea r13, [rip+.L.prof.old]\n");
+  printf("  xor r12d, r12d\n");
+  printf(".L.prof.read:\n");
+  printf("  mov rdi, rbx\n");
+  printf("  lea rsi, [rip+.L.prof.fmt]\n");
+  printf("  lea rdx, [r13+r12*8]\n");
+  printf("  mov eax, 0\n");
+  printf("  call fscanf%s\n", plt(false));
+  printf("  cmp eax, 1\n");
+  printf("  jne .L.prof.close\n");
+  printf("  inc r12\n");
+  printf("  cmp r12, %d\n", n_prof_counters + 1);
+  printf("  jb .L.prof.read\n");
+  printf(".L.prof.close:\n");
+  printf("  mov rdi, rbx\n");
+  printf("  call fclose%s\n", plt(false));
+  printf("  cmp r12, %d\n", n_prof_counters);
+  printf("  jne .L.prof.write\n");
+  printf("  lea rbx, [rip+.L.prof.counters]\n");
+  printf("  xor r12d, r12d\n");
+  printf(".L.prof.add:\n");
+  printf("  mov rax, [r13+r12*8]\n");
+  printf("  add [rbx+r12*8], rax\n");
+  printf("  inc r12\n");
+  printf("  cmp r12, %d\n", n_prof_counters);
+  printf("  jb .L.prof.add\n");
+
+  printf(".L.prof.write:\n");
+  printf("  lea rdi, [rip+.L.prof.path]\n");
+  printf("  lea rsi, [rip+.L.prof.mode]\n");
+  printf("  call fopen%s\n", plt(false));
+  printf("  test rax, rax\n");
+  printf("  je .L.prof.done\n");
+  printf("  mov rbx, rax\n");
+  printf("  lea r13, [rip+.L.prof.counters]\n");
+  printf("  xor r12d, r12d\n");
+  printf(".L.prof.loop:\n");
+  printf("  mov rdi, rbx\n");
+  printf("  lea rsi, [rip+.L.prof.fmt]\n");
+  printf("  mov rdx, [r13+r12*8]\n");
+  printf("  mov eax, 0\n");
+  printf("  call fprintf%s\n", plt(false));
+  printf("  inc r12\n");
+  printf("  cmp r12, %d\n", n_prof_counters);
+  printf("  jb .L.prof.loop\n");
+  printf("  mov rdi, rbx\n");
+  printf("  call fclose%s\n", plt(false));
+  printf(".L.prof.done:\n");
+  printf("  pop r13\n");
+  printf("  pop r12\n");
+  printf("  pop rbx\n");
+  printf("  .cfi_adjust_cfa_offset -24\n");
+  printf("  ret\n");
+  printf("  .cfi_endproc\n");
 }
 
 // Emits data segment.
@@ -309,8 +1795,32 @@ void emit_data(Program *prog) {
 
   for (VarList *vl = prog->globals; vl; vl = vl->next) {
     Var *var = vl->var;
+    if (var->is_extern) {
+      continue;
+    }
+    printf(".type %s, @object\n", var->name);
+    printf(".size %s, %d\n", var->name, var->type->size);
     printf("%s:\n", var->name);
 
+    if (var->initializer) {
+      for (Initializer *init = var->initializer; init; init = init->next) {
+        if (init->label) {
+          printf("  .quad %s%+ld\n", init->label->name, init->val);
+        } else if (init->size == 1) {
+          printf("  .byte %ld\n", init->val);
+        } else if (init->size == 2) {
+          printf("  .short %ld\n", init->val);
+        } else if (init->size == 4) {
+          printf("  .long %ld\n", init->val);
+        } else if (init->size == 8) {
+          printf("  .quad %ld\n", init->val);
+        } else {
+          printf("  .zero %d\n", init->size);
+        }
+      }
+      continue;
+    }
+
     if (!var->contents) {
       printf("  .zero %d\n", var->type->size);
       continue;
@@ -322,9 +1832,174 @@ void emit_data(Program *prog) {
   }
 }
 
-void codegen(Program *prog) {
-  // Output the header of assembly code
+// Emits the call and cycle counters of -finstrument-functions-lite and a
+// destructor which prints them to stderr, sorted by cycles in descending
+// order, when the program exits. Each counter is a pair of the number of
+// calls and the cycles spent in the function including its callees.
+void emit_instrument() {
+  int n = n_fns;
+  if (n == 0) {
+    return;
+  }
+
+  printf(".bss\n");
+  printf(".L.instr.counters:\n");
+  printf("  .zero %d\n", n * 16);
+  // Rows of the report, each holding cycles, calls and a name
+  printf(".L.instr.rows:\n");
+  printf("  .zero %d\n", n * 24);
+
+  printf(".data\n");
+  printf(".L.instr.names:\n");
+  for (int i = 0; i < n; i++) {
+    printf("  .quad .L.instr.name.%s\n", fn_names[i]);
+  }
+  for (int i = 0; i < n; i++) {
+    printf(".L.instr.name.%s:\n", fn_names[i]);
+    printf("  .string \"%s\"\n", fn_names[i]);
+  }
+  printf(".L.instr.header:\n");
+  printf("  .string \"%%-24s %%12s %%16s %%12s\\n\"\n");
+  printf(".L.instr.function:\n");
+  printf("  .string \"function\"\n");
+  printf(".L.instr.calls:\n");
+  printf("  .string \"calls\"\n");
+  printf(".L.instr.cycles:\n");
+  printf("  .string \"cycles\"\n");
+  printf(".L.instr.per_call:\n");
+  printf("  .string \"cycles/call\"\n");
+  printf(".L.instr.fmt:\n");
+  printf("  .string \"%%-24s %%12lu %%16lu %%12lu\\n\"\n");
+
+  printf(".section .fini_array,\"aw\"\n");
+  printf("  .quad .L.instr.dump\n");
+
+  printf(".text\n");
+
+  // Comparison function for qsort() which orders rows by cycles in
+  // descending order
+  printf(".L.instr.cmp:\n");
+  printf("  .cfi_startproc\n");
+  printf("  xor eax, eax\n");
+  printf("  xor ecx, ecx\n");
+  printf("  mov rdx, [rdi]\n");
+  printf("  cmp rdx, [rsi]\n");
+  printf("  setb al\n");
+  printf("  seta cl\n");
+  printf("  sub eax, ecx\n");
+  printf("  ret\n");
+  printf("  .cfi_endproc\n");
+
+  printf(".L.instr.dump:\n");
+  printf("  .cfi_startproc\n");
+  printf("  push rbx\n");
+  printf("  .cfi_adjust_cfa_offset 8\n");
+  printf("  push r12\n");
+  printf("  .cfi_adjust_cfa_offset 8\n");
+  printf("  push r13\n");
+  printf("  .cfi_adjust_cfa_offset 8\n");
+
+  // Copy the counters to the rows, leaving the counters intact for
+  // instrumented code run by later destructors
+  printf("  lea r8, [rip+.L.instr.counters]\n");
+  printf("  lea r9, [rip+.L.instr.names]\n");
+  printf("  lea rdi, [rip+.L.instr.rows]\n");
+  printf("  mov ecx, %d\n", n);
+  printf(".L.instr.copy:\n");
+  printf("  mov rax, [r8+8]\n");
+  printf("  mov [rdi], rax\n");
+  printf("  mov rax, [r8]\n");
+  printf("  mov [rdi+8], rax\n");
+  printf("  mov rax, [r9]\n");
+  printf("  mov [rdi+16], rax\n");
+  printf("  add r8, 16\n");
+  printf("  add r9, 8\n");
+  printf("  add rdi, 24\n");
+  printf("  dec ecx\n");
+  printf("  jnz .L.instr.copy\n");
+
+  printf("  lea rdi, [rip+.L.instr.rows]\n");
+  printf("  mov esi, %d\n", n);
+  printf("  mov edx, 24\n");
+  printf("  lea rcx, [rip+.L.instr.cmp]\n");
+  printf("  call qsort%s\n", plt(false));
+
+  load_stderr("rdi");
+  printf("  lea rsi, [rip+.L.instr.header]\n");
+  printf("  lea rdx, [rip+.L.instr.function]\n");
+  printf("  lea rcx, [rip+.L.instr.calls]\n");
+  printf("  lea r8, [rip+.L.instr.cycles]\n");
+  printf("  lea r9, [rip+.L.instr.per_call]\n");
+  printf("  mov eax, 0\n");
+  printf("  call fprintf%s\n", plt(false));
+
+  // Print the rows of functions which were called
+  printf("  lea rbx, [rip+.L.instr.rows]\n");
+  printf("  mov r12d, %d\n", n);
+  printf(".L.instr.loop:\n");
+  printf("  mov rcx, [rbx+8]\n");
+  printf("  test rcx, rcx\n");
+  printf("  je .L.instr.next\n");
+  printf("  mov rax, [rbx]\n");
+  printf("  xor edx, edx\n");
+  printf("  div rcx\n");
+  printf("  mov r9, rax\n");
+  load_stderr("rdi");
+  printf("  lea rsi, [rip+.L.instr.fmt]\n");
+  printf("  mov rdx, [rbx+16]\n");
+  printf("  mov r8, [rbx]\n");
+  printf("  mov eax, 0\n");
+  printf("  call fprintf%s\n", plt(false));
+  printf(".L.instr.next:\n");
+  printf("  add rbx, 24\n");
+  printf("  dec r12d\n");
+  printf("  jnz .L.instr.loop\n");
+
+  printf("  pop r13\n");
+  printf("  pop r12\n");
+  printf("  pop rbx\n");
+  printf("  .cfi_adjust_cfa_offset -24\n");
+  printf("  ret\n");
+  printf("  .cfi_endproc\n");
+}
+
+// Emits the header of the assembly code. Functions are then emitted one at a
+// time with emit_function().
+void begin_codegen() {
   printf(".intel_syntax noprefix\n");
+  if (debug_info) {
+    printf(".file 1 ");
+    print_quoted(filename);
+    printf("\n");
+  }
+  printf(".text\n");
+  printf(".L.text.begin:\n");
+}
+
+// Emits the global variables of a program and the data and code which
+// depend on all functions having been emitted.
+void end_codegen(Program *prog) {
+  printf(".L.text.end:\n");
   emit_data(prog);
-  emit_text(prog);
+  if (profile_generate) {
+    emit_profile();
+  }
+  if (instrument_functions) {
+    emit_instrument();
+  }
+  if (debug_info) {
+    emit_debug_info();
+  }
+
+  // The stack doesn't need to be executable, which the linker otherwise
+  // assumes and warns about
+  printf(".section .note.GNU-stack,\"\",@progbits\n");
+}
+
+void codegen(Program *prog) {
+  begin_codegen();
+  for (Function *fn = prog->fns; fn; fn = fn->next) {
+    emit_function(fn);
+  }
+  end_codegen(prog);
 }
@@ -0,0 +1,544 @@
+#include "9cc.h"
+
+// Maximum number of AST nodes evaluated for a call with constant arguments
+int constexpr_steps = 100000;
+
+// Maximum nesting of calls evaluated at compile time
+#define MAX_CALL_DEPTH 256
+
+// How the evaluation of a node ends
+typedef enum {
+  FLOW_NEXT,       // Completed normally, with a value if it is an expression
+  FLOW_BREAK,      // "break"
+  FLOW_RETURN,     // "return", with the value in `ret_val`
+  FLOW_INLINE_RET, // "return" out of an inlined body, likewise
+  FLOW_FAIL,       // Can't be evaluated at compile time
+} Flow;
+
+// Value of a local variable in a call being evaluated
+typedef struct Binding Binding;
+struct Binding {
+  Binding *next;
+  Var *var;
+  long val;
+};
+
+// Whether a function is known to be pure
+typedef struct Purity Purity;
+struct Purity {
+  Purity *next;
+  Function *fn;
+  bool is_pure;
+};
+
+Program *eval_prog;
+Purity *purities;
+
+// State of the evaluation in progress
+Binding *env;
+long ret_val;
+long lhs_val;
+int steps_left;
+int call_depth;
+
+// Finds a function definition of `eval_prog` by name.
+Function *lookup_func(char *name) {
+  for (Function *fn = eval_prog->fns; fn; fn = fn->next) {
+    if (!strcmp(fn->name, name)) {
+      return fn;
+    }
+  }
+  return NULL;
+}
+
+bool is_pure_func(Function *fn);
+
+// Returns true if a tree only computes with integer local variables and
+// calls pure functions, so that it neither reads nor writes memory other
+// than its own locals.
+bool is_pure_node(Node *node) {
+  if (!node) {
+    return true;
+  }
+
+  switch (node->kind) {
+  case ND_VAR:
+    return node->var->is_local && is_integer(node->var->type);
+  case ND_CALL: {
+    Function *fn = lookup_func(node->func_name);
+    if (!fn || !is_pure_func(fn)) {
+      return false;
+    }
+    break;
+  }
+  case ND_ADD:
+  case ND_SUB:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_EQ:
+  case ND_NE:
+  case ND_LT:
+  case ND_LE:
+  case ND_ASSIGN:
+  case ND_OP_ASSIGN:
+  case ND_LHS_VAL:
+  case ND_CAST:
+  case ND_RETURN:
+  case ND_IF:
+  case ND_WHILE:
+  case ND_FOR:
+  case ND_SWITCH:
+  case ND_CASE:
+  case ND_BREAK:
+  case ND_EXPR_STMT:
+  case ND_STMT_EXPR:
+  case ND_BLOCK:
+  case ND_INLINE:
+  case ND_INLINE_RET:
+  case ND_NUM:
+  case ND_NULL:
+    break;
+  default:
+    return false;
+  }
+
+  if (!is_pure_node(node->lhs) || !is_pure_node(node->rhs) ||
+      !is_pure_node(node->cond) || !is_pure_node(node->cons) ||
+      !is_pure_node(node->alt) || !is_pure_node(node->init) ||
+      !is_pure_node(node->updt)) {
+    return false;
+  }
+  for (Node *n = node->body; n; n = n->next) {
+    if (!is_pure_node(n)) {
+      return false;
+    }
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    if (!is_pure_node(n)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns true if `fn` has no side effects and its result depends only on
+// its integer arguments. A function is assumed to be pure while its own body
+// is being checked, so that recursive functions can be pure. The evaluator
+// rejects anything impure by itself, so a wrong guess for mutually recursive
+// functions only costs evaluation time.
+bool is_pure_func(Function *fn) {
+  for (Purity *p = purities; p; p = p->next) {
+    if (p->fn == fn) {
+      return p->is_pure;
+    }
+  }
+
+  Purity *p = calloc(1, sizeof(Purity));
+  p->fn = fn;
+  p->is_pure = true;
+  p->next = purities;
+  purities = p;
+
+  bool is_pure = !fn->is_variadic && is_integer(fn->return_type);
+  for (VarList *vl = fn->params; vl && is_pure; vl = vl->next) {
+    is_pure = is_integer(vl->var->type);
+  }
+  for (Node *n = fn->node; n && is_pure; n = n->next) {
+    is_pure = is_pure_node(n);
+  }
+  p->is_pure = is_pure;
+  return is_pure;
+}
+
+Binding *find_binding(Var *var) {
+  for (Binding *b = env; b; b = b->next) {
+    if (b->var == var) {
+      return b;
+    }
+  }
+  return NULL;
+}
+
+// Assigns a value to an integer local variable, truncated to its type.
+Flow bind(Node *lhs, long val, long *result) {
+  if (lhs->kind != ND_VAR || !lhs->var->is_local ||
+      !is_integer(lhs->var->type)) {
+    return FLOW_FAIL;
+  }
+  Binding *b = find_binding(lhs->var);
+  if (!b) {
+    b = calloc(1, sizeof(Binding));
+    b->var = lhs->var;
+    b->next = env;
+    env = b;
+  }
+  b->val = extend_const(val, lhs->var->type);
+  *result = b->val;
+  return FLOW_NEXT;
+}
+
+Flow eval_node(Node *node, long *val);
+
+// Evaluates statements in order.
+Flow eval_stmts(Node *node, long *val) {
+  for (Node *n = node; n; n = n->next) {
+    Flow flow = eval_node(n, val);
+    if (flow != FLOW_NEXT) {
+      return flow;
+    }
+  }
+  return FLOW_NEXT;
+}
+
+// Returns the "case" label of a "switch" body matching `val`, or the
+// "default" label if none does. Nested "switch" statements are skipped.
+Node *find_case(Node *node, long val, Node **dflt) {
+  if (!node || node->kind == ND_SWITCH) {
+    return NULL;
+  }
+  if (node->kind == ND_CASE) {
+    if (node->is_default) {
+      *dflt = node;
+    } else if (node->val == val) {
+      return node;
+    }
+  }
+
+  Node *found = NULL;
+  Node *kids[] = {node->lhs, node->cons, node->alt, node->init};
+  for (int i = 0; i < 4 && !found; i++) {
+    found = find_case(kids[i], val, dflt);
+  }
+  for (Node *n = node->body; n && !found; n = n->next) {
+    found = find_case(n, val, dflt);
+  }
+  return found;
+}
+
+// Returns true if `label` labels statement `node`.
+bool labels(Node *node, Node *label) {
+  for (; node->kind == ND_CASE; node = node->lhs) {
+    if (node == label) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Evaluates a "switch" statement. Only jumps to labels of the statements of
+// the body itself are supported, not into nested statements.
+Flow eval_switch(Node *node, long *val) {
+  long cond;
+  Flow flow = eval_node(node->cond, &cond);
+  if (flow != FLOW_NEXT) {
+    return flow;
+  }
+
+  Node *dflt = NULL;
+  Node *label = find_case(node->cons, cond, &dflt);
+  if (!label) {
+    label = dflt;
+  }
+  if (!label) {
+    return FLOW_NEXT;
+  }
+
+  Node *body = node->cons;
+  Node *start = NULL;
+  if (body->kind == ND_BLOCK) {
+    for (Node *n = body->body; n && !start; n = n->next) {
+      if (labels(n, label)) {
+        start = n;
+      }
+    }
+  } else if (labels(body, label)) {
+    start = body;
+  }
+  if (!start) {
+    return FLOW_FAIL;
+  }
+
+  flow = eval_node(label, val);
+  if (flow == FLOW_NEXT) {
+    flow = eval_stmts(start->next, val);
+  }
+  return flow == FLOW_BREAK ? FLOW_NEXT : flow;
+}
+
+// Frees the bindings of an environment.
+void free_env(Binding *b) {
+  while (b) {
+    Binding *next = b->next;
+    free(b);
+    b = next;
+  }
+}
+
+// Evaluates a call to a pure function with the values of its arguments
+// bound to the parameters in a fresh environment.
+Flow eval_call(Node *node, long *val) {
+  Function *fn = lookup_func(node->func_name);
+  if (!fn || !is_pure_func(fn) || call_depth == MAX_CALL_DEPTH) {
+    return FLOW_FAIL;
+  }
+
+  Binding *callee_env = NULL;
+  Node *arg = node->args;
+  for (VarList *vl = fn->params; vl; vl = vl->next, arg = arg->next) {
+    long v;
+    if (!arg || eval_node(arg, &v) != FLOW_NEXT) {
+      free_env(callee_env);
+      return FLOW_FAIL;
+    }
+    Binding *b = calloc(1, sizeof(Binding));
+    b->var = vl->var;
+    b->val = extend_const(v, vl->var->type);
+    b->next = callee_env;
+    callee_env = b;
+  }
+  if (arg) {
+    free_env(callee_env);
+    return FLOW_FAIL;
+  }
+
+  Binding *caller_env = env;
+  env = callee_env;
+  call_depth++;
+  Flow flow = eval_stmts(fn->node, val);
+  call_depth--;
+  free_env(env);
+  env = caller_env;
+
+  // Falling off the end of a function leaves its value undefined. The copies
+  // kept for inlining under --streaming return via ND_INLINE_RET.
+  if (flow != FLOW_RETURN && flow != FLOW_INLINE_RET) {
+    return FLOW_FAIL;
+  }
+  *val = extend_const(ret_val, node->type);
+  return FLOW_NEXT;
+}
+
+// Evaluates a node, storing the value of an expression to `val`.
+Flow eval_node(Node *node, long *val) {
+  if (--steps_left < 0) {
+    return FLOW_FAIL;
+  }
+
+  long lhs;
+  long rhs;
+  Flow flow;
+  switch (node->kind) {
+  case ND_NUM:
+    *val = node->val;
+    return FLOW_NEXT;
+  case ND_NULL:
+    *val = 0;
+    return FLOW_NEXT;
+  case ND_VAR: {
+    Binding *b = find_binding(node->var);
+    // Reading an uninitialized variable gives an unpredictable value
+    if (!b) {
+      return FLOW_FAIL;
+    }
+    *val = b->val;
+    return FLOW_NEXT;
+  }
+  case ND_CAST:
+    flow = eval_node(node->lhs, &lhs);
+    *val = extend_const(lhs, node->type);
+    return flow;
+  case ND_ADD:
+  case ND_SUB:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_EQ:
+  case ND_NE:
+  case ND_LT:
+  case ND_LE:
+    flow = eval_node(node->lhs, &lhs);
+    if (flow == FLOW_NEXT) {
+      flow = eval_node(node->rhs, &rhs);
+    }
+    if (flow == FLOW_NEXT && !fold_binary(node, lhs, rhs, val)) {
+      return FLOW_FAIL;
+    }
+    return flow;
+  case ND_ASSIGN:
+    flow = eval_node(node->rhs, &rhs);
+    if (flow != FLOW_NEXT) {
+      return flow;
+    }
+    return bind(node->lhs, rhs, val);
+  case ND_OP_ASSIGN: {
+    if (node->lhs->kind != ND_VAR || !find_binding(node->lhs->var)) {
+      return FLOW_FAIL;
+    }
+    long old = find_binding(node->lhs->var)->val;
+    long saved = lhs_val;
+    lhs_val = old;
+    flow = eval_node(node->rhs, &rhs);
+    lhs_val = saved;
+    if (flow != FLOW_NEXT) {
+      return flow;
+    }
+    flow = bind(node->lhs, rhs, val);
+    if (node->is_postfix) {
+      *val = old;
+    }
+    return flow;
+  }
+  case ND_LHS_VAL:
+    *val = lhs_val;
+    return FLOW_NEXT;
+  case ND_EXPR_STMT:
+    return eval_node(node->lhs, val);
+  case ND_BLOCK:
+  case ND_STMT_EXPR:
+    return eval_stmts(node->body, val);
+  case ND_RETURN:
+  case ND_INLINE_RET:
+    flow = eval_node(node->lhs, &ret_val);
+    if (flow != FLOW_NEXT) {
+      return flow;
+    }
+    return node->kind == ND_RETURN ? FLOW_RETURN : FLOW_INLINE_RET;
+  case ND_INLINE:
+    flow = eval_stmts(node->body, val);
+    if (flow != FLOW_INLINE_RET) {
+      return FLOW_FAIL;
+    }
+    *val = extend_const(ret_val, node->type);
+    return FLOW_NEXT;
+  case ND_IF:
+    flow = eval_node(node->cond, &lhs);
+    if (flow != FLOW_NEXT) {
+      return flow;
+    }
+    if (lhs) {
+      return eval_node(node->cons, val);
+    }
+    return node->alt ? eval_node(node->alt, val) : FLOW_NEXT;
+  case ND_WHILE:
+  case ND_FOR:
+    if (node->init && (flow = eval_node(node->init, val)) != FLOW_NEXT) {
+      return flow;
+    }
+    for (;;) {
+      if (node->cond) {
+        flow = eval_node(node->cond, &lhs);
+        if (flow != FLOW_NEXT) {
+          return flow;
+        }
+        if (!lhs) {
+          return FLOW_NEXT;
+        }
+      }
+      flow = eval_node(node->cons, val);
+      if (flow == FLOW_BREAK) {
+        return FLOW_NEXT;
+      }
+      if (flow != FLOW_NEXT) {
+        return flow;
+      }
+      if (node->updt && (flow = eval_node(node->updt, val)) != FLOW_NEXT) {
+        return flow;
+      }
+    }
+  case ND_SWITCH:
+    return eval_switch(node, val);
+  case ND_CASE:
+    return eval_node(node->lhs, val);
+  case ND_BREAK:
+    return FLOW_BREAK;
+  case ND_CALL:
+    return eval_call(node, val);
+  default:
+    return FLOW_FAIL;
+  }
+}
+
+// Returns true if an argument is a constant expression, which can be
+// evaluated without reading variables or having side effects.
+bool is_const_arg(Node *node) {
+  switch (node->kind) {
+  case ND_NUM:
+    return true;
+  case ND_CAST:
+    return is_const_arg(node->lhs);
+  case ND_ADD:
+  case ND_SUB:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_EQ:
+  case ND_NE:
+  case ND_LT:
+  case ND_LE:
+    return is_const_arg(node->lhs) && is_const_arg(node->rhs);
+  default:
+    return false;
+  }
+}
+
+// Replaces a call to a pure function whose arguments are all constants with
+// its result, if it can be computed within the step budget.
+void fold_call(Node *node) {
+  for (Node *arg = node->args; arg; arg = arg->next) {
+    if (!is_const_arg(arg)) {
+      return;
+    }
+  }
+
+  env = NULL;
+  call_depth = 0;
+  steps_left = constexpr_steps;
+  long val;
+  if (eval_node(node, &val) != FLOW_NEXT) {
+    return;
+  }
+
+  node->kind = ND_NUM;
+  node->val = val;
+  node->args = NULL;
+}
+
+// Folds calls in a tree bottom-up, so that a call whose arguments are
+// themselves foldable calls can be folded in turn.
+void fold_calls(Node *node) {
+  if (!node) {
+    return;
+  }
+
+  fold_calls(node->lhs);
+  fold_calls(node->rhs);
+  fold_calls(node->cond);
+  fold_calls(node->cons);
+  fold_calls(node->alt);
+  fold_calls(node->init);
+  fold_calls(node->updt);
+  for (Node *n = node->body; n; n = n->next) {
+    fold_calls(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    fold_calls(n);
+  }
+
+  if (node->kind == ND_CALL && constexpr_steps > 0) {
+    fold_call(node);
+  }
+}
+
+// Replaces calls in `fn` to pure functions of `p` with constant arguments
+// by their results.
+void consteval_function(Program *p, Function *fn) {
+  eval_prog = p;
+  for (Node *node = fn->node; node; node = node->next) {
+    fold_calls(node);
+  }
+}
+
+// Evaluates calls to pure functions with constant arguments at compile time.
+void consteval_calls(Program *p) {
+  for (Function *fn = p->fns; fn; fn = fn->next) {
+    consteval_function(p, fn);
+  }
+}
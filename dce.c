@@ -0,0 +1,539 @@
+#include "9cc.h"
+
+Node *dce_stmts(Node *node);
+Node *dce_stmt(Node *node);
+Node *dce_expr(Node *node);
+
+Node *new_null_stmt(Token *tok) {
+  Node *node = new_object(OBJ_NODE, sizeof(Node));
+  node->kind = ND_NULL;
+  node->tok = tok;
+  return node;
+}
+
+// Returns true if evaluating an expression may change the program state.
+bool has_side_effects(Node *node) {
+  if (!node) {
+    return false;
+  }
+
+  switch (node->kind) {
+  case ND_ASSIGN:
+  case ND_OP_ASSIGN:
+  case ND_CALL:
+  case ND_INLINE:
+  case ND_STMT_EXPR:
+    return true;
+  default:
+    return has_side_effects(node->lhs) || has_side_effects(node->rhs);
+  }
+}
+
+// Returns true if a statement contains a "case" or "default" label of the
+// enclosing "switch", through which it may be entered.
+bool has_case_label(Node *node) {
+  if (!node || node->kind == ND_SWITCH) {
+    return false;
+  }
+  if (node->kind == ND_CASE) {
+    return true;
+  }
+
+  if (has_case_label(node->lhs) || has_case_label(node->cons) ||
+      has_case_label(node->alt) || has_case_label(node->init)) {
+    return true;
+  }
+  for (Node *n = node->body; n; n = n->next) {
+    if (has_case_label(n)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns true if control never continues to the statement after `node`.
+bool is_jump(Node *node) {
+  return node->kind == ND_RETURN || node->kind == ND_INLINE_RET ||
+         node->kind == ND_BREAK;
+}
+
+// Truncates a constant to an integer type and extends it back to 64 bits,
+// which is how the generated code holds a value of the type.
+long extend_const(long val, Type *type) {
+  switch (type->size) {
+  case 1:
+    return type->is_unsigned ? (long)(unsigned char)val : (signed char)val;
+  case 2:
+    return type->is_unsigned ? (long)(unsigned short)val : (short)val;
+  case 4:
+    return type->is_unsigned ? (long)(unsigned int)val : (int)val;
+  default:
+    return val;
+  }
+}
+
+// Evaluates an integer operator whose operands are constants. Arithmetic
+// wraps around like the generated code does. Returns false if the result
+// can't be computed at compile time.
+bool fold_binary(Node *node, long lhs, long rhs, long *val) {
+  unsigned long l = lhs;
+  unsigned long r = rhs;
+  bool is_unsigned = node->type->is_unsigned;
+
+  switch (node->kind) {
+  case ND_ADD:
+    *val = extend_const(l + r, node->type);
+    return true;
+  case ND_SUB:
+    *val = extend_const(l - r, node->type);
+    return true;
+  case ND_MUL:
+    *val = extend_const(l * r, node->type);
+    return true;
+  case ND_DIV:
+    if (rhs == 0) {
+      return false;
+    }
+    if (is_unsigned && node->type->size == 8) {
+      *val = l / r;
+    } else {
+      *val = extend_const(rhs == -1 ? -l : lhs / rhs, node->type);
+    }
+    return true;
+  case ND_EQ:
+    *val = lhs == rhs;
+    return true;
+  case ND_NE:
+    *val = lhs != rhs;
+    return true;
+  case ND_LT:
+    *val = is_unsigned_cmp(node) ? l < r : lhs < rhs;
+    return true;
+  case ND_LE:
+    *val = is_unsigned_cmp(node) ? l <= r : lhs <= rhs;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Simplifies an expression, folding integer operators with constant operands
+// and eliminating dead code in statement expressions.
+Node *dce_expr(Node *node) {
+  if (!node) {
+    return NULL;
+  }
+
+  node->lhs = dce_expr(node->lhs);
+  node->rhs = dce_expr(node->rhs);
+  // Expressions are simplified in place, so argument lists stay linked
+  for (Node *n = node->args; n; n = n->next) {
+    dce_expr(n);
+  }
+
+  switch (node->kind) {
+  case ND_STMT_EXPR: {
+    // The last node is the value of the statement expression, so it is kept
+    // even if it is unreachable.
+    Node *last = node->body;
+    while (last->next) {
+      last = last->next;
+    }
+
+    Node head = {};
+    Node *cur = &head;
+    bool reachable = true;
+    for (Node *n = node->body; n != last;) {
+      Node *next = n->next;
+      Node *stmt = reachable || has_case_label(n) ? dce_stmt(n) : NULL;
+      if (stmt) {
+        cur->next = stmt;
+        cur = cur->next;
+        reachable = !is_jump(stmt);
+      }
+      n = next;
+    }
+    cur->next = dce_expr(last);
+    node->body = head.next;
+    return node;
+  }
+  case ND_INLINE:
+    node->body = dce_stmts(node->body);
+    return node;
+  default:
+    break;
+  }
+
+  if (node->kind == ND_CAST && node->lhs->kind == ND_NUM) {
+    node->kind = ND_NUM;
+    node->val = extend_const(node->lhs->val, node->type);
+    node->lhs = NULL;
+    return node;
+  }
+
+  if (node->lhs && node->rhs && node->lhs->kind == ND_NUM &&
+      node->rhs->kind == ND_NUM && is_integer(node->type)) {
+    long val;
+    if (fold_binary(node, node->lhs->val, node->rhs->val, &val)) {
+      node->kind = ND_NUM;
+      node->val = val;
+      node->lhs = NULL;
+      node->rhs = NULL;
+    }
+  }
+  return node;
+}
+
+// Eliminates dead code in a statement list, dropping statements that have no
+// effect and statements following a jump, unless a "case" label makes them
+// reachable again.
+Node *dce_stmts(Node *node) {
+  Node head = {};
+  Node *cur = &head;
+  bool reachable = true;
+
+  for (Node *n = node; n;) {
+    Node *next = n->next;
+    Node *stmt = reachable || has_case_label(n) ? dce_stmt(n) : NULL;
+    if (stmt) {
+      cur->next = stmt;
+      cur = cur->next;
+      reachable = !is_jump(stmt);
+    }
+    n = next;
+  }
+
+  cur->next = NULL;
+  return head.next;
+}
+
+// Eliminates dead code in a statement. It returns the simplified statement,
+// or NULL if the statement does nothing.
+Node *dce_stmt(Node *node) {
+  switch (node->kind) {
+  case ND_NULL:
+    return NULL;
+  case ND_EXPR_STMT:
+    node->lhs = dce_expr(node->lhs);
+    return has_side_effects(node->lhs) ? node : NULL;
+  case ND_RETURN:
+  case ND_INLINE_RET:
+    node->lhs = dce_expr(node->lhs);
+    return node;
+  case ND_BLOCK:
+    node->body = dce_stmts(node->body);
+    return node->body ? node : NULL;
+  case ND_IF: {
+    node->cond = dce_expr(node->cond);
+    if (node->cond->kind == ND_NUM && !has_case_label(node)) {
+      Node *taken = node->cond->val ? node->cons : node->alt;
+      return taken ? dce_stmt(taken) : NULL;
+    }
+
+    Node *cons = dce_stmt(node->cons);
+    node->cons = cons ? cons : new_null_stmt(node->tok);
+    node->alt = node->alt ? dce_stmt(node->alt) : NULL;
+    if (!cons && !node->alt && !has_side_effects(node->cond)) {
+      return NULL;
+    }
+    return node;
+  }
+  case ND_WHILE: {
+    node->cond = dce_expr(node->cond);
+    if (node->cond->kind == ND_NUM && !node->cond->val &&
+        !has_case_label(node)) {
+      return NULL;
+    }
+    Node *cons = dce_stmt(node->cons);
+    node->cons = cons ? cons : new_null_stmt(node->tok);
+    return node;
+  }
+  case ND_FOR: {
+    node->init = node->init ? dce_stmt(node->init) : NULL;
+    if (node->cond) {
+      node->cond = dce_expr(node->cond);
+      if (node->cond->kind == ND_NUM) {
+        if (!node->cond->val && !has_case_label(node)) {
+          return node->init;
+        }
+        if (node->cond->val) {
+          node->cond = NULL;
+        }
+      }
+    }
+    node->updt = node->updt ? dce_stmt(node->updt) : NULL;
+    Node *cons = dce_stmt(node->cons);
+    node->cons = cons ? cons : new_null_stmt(node->tok);
+    return node;
+  }
+  case ND_SWITCH: {
+    node->cond = dce_expr(node->cond);
+    Node *cons = dce_stmt(node->cons);
+    node->cons = cons ? cons : new_null_stmt(node->tok);
+    return node;
+  }
+  case ND_CASE: {
+    Node *stmt = dce_stmt(node->lhs);
+    node->lhs = stmt ? stmt : new_null_stmt(node->tok);
+    return node;
+  }
+  default:
+    return node;
+  }
+}
+
+// Returns true if `node` designates an object in the current stack frame.
+bool is_local_object(Node *node) {
+  if (node->kind == ND_MEMBER) {
+    return is_local_object(node->lhs);
+  }
+  return node->kind == ND_VAR && node->var->is_local;
+}
+
+// Returns true if the address of a local variable may be computed in a tree,
+// either with "&" or by an array decaying to a pointer.
+bool may_escape_local(Node *node) {
+  if (!node) {
+    return false;
+  }
+  if (node->kind == ND_ADDR && is_local_object(node->lhs)) {
+    return true;
+  }
+  if (node->type && node->type->kind == TYPE_ARRAY && is_local_object(node)) {
+    return true;
+  }
+
+  if (may_escape_local(node->lhs) || may_escape_local(node->rhs) ||
+      may_escape_local(node->cond) || may_escape_local(node->cons) ||
+      may_escape_local(node->alt) || may_escape_local(node->init) ||
+      may_escape_local(node->updt)) {
+    return true;
+  }
+  for (Node *n = node->body; n; n = n->next) {
+    if (may_escape_local(n)) {
+      return true;
+    }
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    if (may_escape_local(n)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Sets `is_used` of variables referenced in a tree. If `stores` is false,
+// variables that are only assigned to are not marked.
+void mark_vars(Node *node, bool stores) {
+  if (!node) {
+    return;
+  }
+
+  if (node->kind == ND_VAR) {
+    node->var->is_used = true;
+    return;
+  }
+
+  if (node->kind == ND_ASSIGN && !stores && node->lhs->kind == ND_VAR) {
+    mark_vars(node->rhs, stores);
+    return;
+  }
+
+  mark_vars(node->lhs, stores);
+  mark_vars(node->rhs, stores);
+  mark_vars(node->cond, stores);
+  mark_vars(node->cons, stores);
+  mark_vars(node->alt, stores);
+  mark_vars(node->init, stores);
+  mark_vars(node->updt, stores);
+  for (Node *n = node->body; n; n = n->next) {
+    mark_vars(n, stores);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    mark_vars(n, stores);
+  }
+}
+
+void mark_fn_vars(Function *fn, bool stores) {
+  for (VarList *vl = fn->locals; vl; vl = vl->next) {
+    vl->var->is_used = false;
+  }
+  for (Node *node = fn->node; node; node = node->next) {
+    mark_vars(node, stores);
+  }
+}
+
+// Removes assignments to local variables that are never read, keeping the
+// side effects of the assigned values. Returns true if anything is removed.
+bool remove_dead_stores(Node *node) {
+  if (!node) {
+    return false;
+  }
+
+  bool changed = false;
+  if (node->kind == ND_EXPR_STMT) {
+    Node *expr = node->lhs;
+    while (expr->kind == ND_ASSIGN && expr->lhs->kind == ND_VAR &&
+           expr->lhs->var->is_local && !expr->lhs->var->is_used) {
+      expr = expr->rhs;
+      changed = true;
+    }
+    node->lhs = expr;
+  }
+
+  changed |= remove_dead_stores(node->lhs);
+  changed |= remove_dead_stores(node->rhs);
+  changed |= remove_dead_stores(node->cond);
+  changed |= remove_dead_stores(node->cons);
+  changed |= remove_dead_stores(node->alt);
+  changed |= remove_dead_stores(node->init);
+  changed |= remove_dead_stores(node->updt);
+  for (Node *n = node->body; n; n = n->next) {
+    changed |= remove_dead_stores(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    changed |= remove_dead_stores(n);
+  }
+  return changed;
+}
+
+void dce_function(Function *fn) {
+  fn->node = dce_stmts(fn->node);
+
+  // A pointer to a local may be used to access any other local, so variables
+  // are only removed if no address is taken.
+  for (Node *node = fn->node; node; node = node->next) {
+    if (may_escape_local(node)) {
+      return;
+    }
+  }
+
+  // Assignments to unread locals are removed, and the assigned values may in
+  // turn turn out to be pure, so repeat until nothing changes.
+  for (;;) {
+    mark_fn_vars(fn, false);
+    bool changed = false;
+    for (Node *node = fn->node; node; node = node->next) {
+      changed |= remove_dead_stores(node);
+    }
+    if (!changed) {
+      break;
+    }
+    fn->node = dce_stmts(fn->node);
+  }
+
+  // Drop locals which no longer take part in the code. Parameters are kept
+  // since they are stored in the prologue.
+  mark_fn_vars(fn, true);
+  for (VarList *vl = fn->params; vl; vl = vl->next) {
+    vl->var->is_used = true;
+  }
+
+  VarList head = {};
+  VarList *cur = &head;
+  for (VarList *vl = fn->locals; vl; vl = vl->next) {
+    if (vl->var->is_used) {
+      cur->next = vl;
+      cur = cur->next;
+    }
+  }
+  cur->next = NULL;
+  fn->locals = head.next;
+}
+
+// Returns true if `fn` is called from a tree.
+bool is_called(Node *node, char *name) {
+  if (!node) {
+    return false;
+  }
+  if (node->kind == ND_CALL && !strcmp(node->func_name, name)) {
+    return true;
+  }
+
+  if (is_called(node->lhs, name) || is_called(node->rhs, name) ||
+      is_called(node->cond, name) || is_called(node->cons, name) ||
+      is_called(node->alt, name) || is_called(node->init, name) ||
+      is_called(node->updt, name)) {
+    return true;
+  }
+  for (Node *n = node->body; n; n = n->next) {
+    if (is_called(n, name)) {
+      return true;
+    }
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    if (is_called(n, name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Removes static functions which are not called from any remaining function,
+// and string literals which are not referenced anymore.
+void remove_unused_symbols(Program *prog) {
+  for (;;) {
+    bool changed = false;
+    Function head = {};
+    Function *cur = &head;
+
+    for (Function *fn = prog->fns; fn; fn = fn->next) {
+      bool used = !fn->is_static;
+      for (Function *f = prog->fns; f && !used; f = f->next) {
+        for (Node *node = f->node; node && !used; node = node->next) {
+          used = f != fn && is_called(node, fn->name);
+        }
+      }
+
+      if (used) {
+        cur->next = fn;
+        cur = cur->next;
+      } else {
+        changed = true;
+      }
+    }
+
+    cur->next = NULL;
+    prog->fns = head.next;
+    if (!changed) {
+      break;
+    }
+  }
+
+  for (VarList *vl = prog->globals; vl; vl = vl->next) {
+    vl->var->is_used = false;
+  }
+  for (Function *fn = prog->fns; fn; fn = fn->next) {
+    for (Node *node = fn->node; node; node = node->next) {
+      mark_vars(node, true);
+    }
+  }
+  for (VarList *vl = prog->globals; vl; vl = vl->next) {
+    for (Initializer *init = vl->var->initializer; init; init = init->next) {
+      if (init->label) {
+        init->label->is_used = true;
+      }
+    }
+  }
+
+  VarList head = {};
+  VarList *cur = &head;
+  for (VarList *vl = prog->globals; vl; vl = vl->next) {
+    if (vl->var->is_used || !vl->var->contents) {
+      cur->next = vl;
+      cur = cur->next;
+    }
+  }
+  cur->next = NULL;
+  prog->globals = head.next;
+}
+
+// Removes unreachable statements, branches on constant conditions,
+// expression statements without side effects, stores to and slots of unused
+// local variables, and unreferenced static functions.
+void eliminate_dead_code(Program *prog) {
+  for (Function *fn = prog->fns; fn; fn = fn->next) {
+    dce_function(fn);
+  }
+  remove_unused_symbols(prog);
+}
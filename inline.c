@@ -0,0 +1,335 @@
+#include "9cc.h"
+
+// Mapping from a callee's local variable to its copy in the caller
+typedef struct VarMap VarMap;
+struct VarMap {
+  VarMap *next;
+  Var *from;
+  Var *to;
+};
+
+Program *prog;
+Function *caller;
+
+// Finds a function definition by name. If the function is only declared, it
+// returns NULL.
+Function *find_func(char *name) {
+  for (Function *fn = prog->fns; fn; fn = fn->next) {
+    if (!strcmp(fn->name, name)) {
+      return fn;
+    }
+  }
+  return NULL;
+}
+
+// Returns the number of nodes in a tree, which is used as the cost of
+// inlining.
+int node_cost(Node *node) {
+  if (!node) {
+    return 0;
+  }
+
+  int cost = 1 + node_cost(node->lhs) + node_cost(node->rhs) +
+             node_cost(node->cond) + node_cost(node->cons) +
+             node_cost(node->alt) + node_cost(node->init) +
+             node_cost(node->updt);
+  for (Node *n = node->body; n; n = n->next) {
+    cost += node_cost(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    cost += node_cost(n);
+  }
+  return cost;
+}
+
+// Returns true if a tree contains a call to a function named `name`.
+bool calls(Node *node, char *name) {
+  if (!node) {
+    return false;
+  }
+  if (node->kind == ND_CALL && !strcmp(node->func_name, name)) {
+    return true;
+  }
+
+  if (calls(node->lhs, name) || calls(node->rhs, name) ||
+      calls(node->cond, name) || calls(node->cons, name) ||
+      calls(node->alt, name) || calls(node->init, name) ||
+      calls(node->updt, name)) {
+    return true;
+  }
+  for (Node *n = node->body; n; n = n->next) {
+    if (calls(n, name)) {
+      return true;
+    }
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    if (calls(n, name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns true if the parameters of `fn` can be initialized by assignment,
+// which arrays can't take. Structs aren't passed by value either.
+bool has_scalar_params(Function *fn) {
+  for (VarList *vl = fn->params; vl; vl = vl->next) {
+    TypeKind kind = vl->var->type->kind;
+    if (kind == TYPE_ARRAY || kind == TYPE_STRUCT) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns true if calls to `fn` may be replaced with its body in some
+// caller, in which case streaming compilation keeps the body.
+bool is_inline_candidate(Function *fn) {
+  if (fn->is_variadic || !has_scalar_params(fn)) {
+    return false;
+  }
+  int cost = 0;
+  for (Node *n = fn->node; n; n = n->next) {
+    cost += node_cost(n);
+  }
+  return cost <= inline_limit;
+}
+
+// Returns true if a call to `fn` can be replaced with its body.
+bool is_inlinable(Function *fn) {
+  if (fn == caller || fn->is_variadic || !has_scalar_params(fn)) {
+    return false;
+  }
+
+  // With a profile, code which never runs isn't worth growing, and a hot
+  // callee is worth a larger body
+  int limit = inline_limit;
+  if (is_cold_function(caller)) {
+    return false;
+  }
+  if (is_hot_function(fn)) {
+    limit *= 4;
+  }
+
+  // Inlining a function which calls back into the caller would turn mutual
+  // recursion into non-tail recursion
+  int cost = 0;
+  for (Node *n = fn->node; n; n = n->next) {
+    if (calls(n, fn->name) || calls(n, caller->name)) {
+      return false;
+    }
+    cost += node_cost(n);
+  }
+  return cost <= limit;
+}
+
+// Returns the copy of `var` if it is a local variable of the callee.
+Var *map_var(VarMap *map, Var *var) {
+  for (VarMap *m = map; m; m = m->next) {
+    if (m->from == var) {
+      return m->to;
+    }
+  }
+  return var;
+}
+
+Node *copy_node(Node *node, VarMap *map);
+
+Node *copy_list(Node *node, VarMap *map) {
+  Node head = {};
+  Node *cur = &head;
+  for (Node *n = node; n; n = n->next) {
+    cur->next = copy_node(n, map);
+    cur = cur->next;
+  }
+  return head.next;
+}
+
+// Makes a deep copy of a tree, replacing the callee's local variables with
+// their copies and "return" with ND_INLINE_RET.
+Node *copy_node(Node *node, VarMap *map) {
+  if (!node) {
+    return NULL;
+  }
+
+  Node *copy = new_object(OBJ_NODE, sizeof(Node));
+  *copy = *node;
+  copy->next = NULL;
+  copy->lhs = copy_node(node->lhs, map);
+  copy->rhs = copy_node(node->rhs, map);
+  copy->cond = copy_node(node->cond, map);
+  copy->cons = copy_node(node->cons, map);
+  copy->alt = copy_node(node->alt, map);
+  copy->init = copy_node(node->init, map);
+  copy->updt = copy_node(node->updt, map);
+  copy->body = copy_list(node->body, map);
+  copy->args = copy_list(node->args, map);
+
+  if (node->kind == ND_RETURN) {
+    copy->kind = ND_INLINE_RET;
+  }
+
+  // Besides ND_VAR, a vectorized loop refers to its induction variable
+  if (node->var) {
+    copy->var = map_var(map, node->var);
+  }
+  return copy;
+}
+
+// Returns a copy of `fn` with its own local variables, from which calls can
+// be inlined after the body of `fn` is optimized or released. "return" is
+// already ND_INLINE_RET in the copy, which is only used for inlining.
+Function *copy_for_inlining(Function *fn) {
+  Function *copy = calloc(1, sizeof(Function));
+  *copy = *fn;
+  copy->next = NULL;
+
+  VarMap *map = NULL;
+  VarList head = {};
+  VarList *cur = &head;
+  for (VarList *vl = fn->locals; vl; vl = vl->next) {
+    Var *var = new_object(OBJ_VAR, sizeof(Var));
+    *var = *vl->var;
+
+    VarMap *m = calloc(1, sizeof(VarMap));
+    m->from = vl->var;
+    m->to = var;
+    m->next = map;
+    map = m;
+
+    cur->next = calloc(1, sizeof(VarList));
+    cur = cur->next;
+    cur->var = var;
+  }
+  copy->locals = head.next;
+
+  head.next = NULL;
+  cur = &head;
+  for (VarList *vl = fn->params; vl; vl = vl->next) {
+    cur->next = calloc(1, sizeof(VarList));
+    cur = cur->next;
+    cur->var = map_var(map, vl->var);
+  }
+  copy->params = head.next;
+
+  copy->node = copy_list(fn->node, map);
+  return copy;
+}
+
+// Replaces an ND_CALL node with the body of `fn` in place. The call becomes
+// a statement expression-like ND_INLINE node which first assigns arguments to
+// fresh copies of the parameters.
+void inline_call(Node *node, Function *fn) {
+  // Give every local variable of the callee a fresh copy in the caller
+  VarMap *map = NULL;
+  for (VarList *vl = fn->locals; vl; vl = vl->next) {
+    Var *var = new_object(OBJ_VAR, sizeof(Var));
+    *var = *vl->var;
+    // The scope numbers of the callee don't apply to the caller
+    var->scope_begin = var->scope_end = 0;
+
+    VarMap *m = calloc(1, sizeof(VarMap));
+    m->from = vl->var;
+    m->to = var;
+    m->next = map;
+    map = m;
+
+    VarList *local = calloc(1, sizeof(VarList));
+    local->var = var;
+    local->next = caller->locals;
+    caller->locals = local;
+  }
+
+  // Assign arguments to the parameters
+  Node head = {};
+  Node *cur = &head;
+  Node *arg = node->args;
+  for (VarList *param = fn->params; param; param = param->next) {
+    Node *next = arg->next;
+    arg->next = NULL;
+
+    Node *lhs = new_object(OBJ_NODE, sizeof(Node));
+    lhs->kind = ND_VAR;
+    lhs->tok = arg->tok;
+    lhs->var = map_var(map, param->var);
+    lhs->type = lhs->var->type;
+
+    Node *assign = new_object(OBJ_NODE, sizeof(Node));
+    assign->kind = ND_ASSIGN;
+    assign->tok = arg->tok;
+    assign->type = lhs->type;
+    assign->lhs = lhs;
+    assign->rhs = arg;
+
+    Node *stmt = new_object(OBJ_NODE, sizeof(Node));
+    stmt->kind = ND_EXPR_STMT;
+    stmt->tok = arg->tok;
+    stmt->lhs = assign;
+
+    cur->next = stmt;
+    cur = cur->next;
+    arg = next;
+  }
+
+  cur->next = copy_list(fn->node, map);
+
+  node->kind = ND_INLINE;
+  node->func = fn;
+  node->body = head.next;
+  node->args = NULL;
+}
+
+void inline_node(Node *node) {
+  if (!node) {
+    return;
+  }
+
+  inline_node(node->lhs);
+  inline_node(node->rhs);
+  inline_node(node->cond);
+  inline_node(node->cons);
+  inline_node(node->alt);
+  inline_node(node->init);
+  inline_node(node->updt);
+  for (Node *n = node->body; n; n = n->next) {
+    inline_node(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    inline_node(n);
+  }
+
+  if (node->kind != ND_CALL) {
+    return;
+  }
+
+  // An implicitly declared function may be called with a wrong number of
+  // arguments, which is left as is.
+  int n_args = 0;
+  for (Node *arg = node->args; arg; arg = arg->next) {
+    n_args++;
+  }
+
+  Function *fn = find_func(node->func_name);
+  if (fn && fn->n_params == n_args && is_inlinable(fn)) {
+    inline_call(node, fn);
+  }
+}
+
+// Substitutes calls in `fn` to small non-recursive functions of `p` with
+// their bodies.
+void inline_function(Program *p, Function *fn) {
+  prog = p;
+  caller = fn;
+  for (Node *node = fn->node; node; node = node->next) {
+    inline_node(node);
+  }
+}
+
+// Substitutes calls to small non-recursive functions with their bodies.
+// Functions are visited in order, so callees defined earlier have already had
+// their own calls inlined when they are copied into a caller.
+void inline_functions(Program *p) {
+  for (Function *fn = p->fns; fn; fn = fn->next) {
+    inline_function(p, fn);
+  }
+}
@@ -0,0 +1,322 @@
+#include "9cc.h"
+
+// Returns true if two local variables may be alive at the same time.
+bool lifetimes_overlap(Var *a, Var *b) {
+  if (!a->scope_end || !b->scope_end) {
+    return true;
+  }
+  return a->scope_begin <= b->scope_end && b->scope_begin <= a->scope_end;
+}
+
+// Returns true if a variable placed at `offset` overlaps a placed variable
+// `other` in memory.
+bool slots_overlap(int offset, int size, Var *other) {
+  int end = offset - size;
+  int other_end = other->offset - other->type->size;
+  return end < other->offset && other_end < offset;
+}
+
+// Sorts local variables by alignment and then size, both in descending order,
+// so that few padding bytes are needed between them.
+Var **sort_locals(Function *fn, int *len) {
+  int n = 0;
+  for (VarList *vl = fn->locals; vl; vl = vl->next) {
+    n++;
+  }
+
+  Var **vars = calloc(n, sizeof(Var *));
+  n = 0;
+  for (VarList *vl = fn->locals; vl; vl = vl->next) {
+    if (!vl->var->reg) {
+      vars[n++] = vl->var;
+    }
+  }
+
+  // Insertion sort, which is stable and keeps the declaration order among
+  // variables of the same kind
+  for (int i = 1; i < n; i++) {
+    Var *var = vars[i];
+    int j = i - 1;
+    for (; j >= 0; j--) {
+      Type *t = vars[j]->type;
+      if (t->align > var->type->align ||
+          (t->align == var->type->align && t->size >= var->type->size)) {
+        break;
+      }
+      vars[j + 1] = vars[j];
+    }
+    vars[j + 1] = var;
+  }
+
+  *len = n;
+  return vars;
+}
+
+// Places each local variable at the lowest offset which is suitably aligned
+// and doesn't overlap variables whose lifetime overlaps with it. Variables in
+// disjoint block scopes may thus share the same stack slot.
+void pack_locals(Function *fn) {
+  int n;
+  Var **vars = sort_locals(fn, &n);
+  int frame = 0;
+
+  for (int i = 0; i < n; i++) {
+    Var *var = vars[i];
+    int size = var->type->size;
+    int align = var->type->align;
+
+    // The lowest feasible offset is either right above the frame base or
+    // right above a conflicting variable, so try those in increasing order.
+    int offset = align_to(size, align);
+    for (;;) {
+      int next = offset;
+      for (int j = 0; j < i; j++) {
+        Var *other = vars[j];
+        if (lifetimes_overlap(var, other) &&
+            slots_overlap(offset, size, other)) {
+          int above = align_to(other->offset + size, align);
+          if (next == offset || above < next) {
+            next = above;
+          }
+        }
+      }
+      if (next == offset) {
+        break;
+      }
+      offset = next;
+    }
+
+    var->offset = offset;
+    if (frame < offset) {
+      frame = offset;
+    }
+  }
+
+  fn->stack_size = align_to(frame, 16);
+}
+
+// Returns true if a tree contains a function call.
+bool has_call(Node *node) {
+  if (!node) {
+    return false;
+  }
+  if (node->kind == ND_CALL) {
+    return true;
+  }
+
+  if (has_call(node->lhs) || has_call(node->rhs) || has_call(node->cond) ||
+      has_call(node->cons) || has_call(node->alt) || has_call(node->init) ||
+      has_call(node->updt)) {
+    return true;
+  }
+  for (Node *n = node->body; n; n = n->next) {
+    if (has_call(n)) {
+      return true;
+    }
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    if (has_call(n)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Takes the registers away from parameters which are assigned or whose
+// address is taken in a tree, so that they are kept in memory.
+void find_memory_params(Node *node) {
+  if (!node) {
+    return;
+  }
+
+  if (node->kind == ND_ADDR || node->kind == ND_ASSIGN ||
+      node->kind == ND_OP_ASSIGN || node->kind == ND_MEMZERO) {
+    if (node->lhs->kind == ND_VAR) {
+      node->lhs->var->reg = NULL;
+    }
+  }
+  if (node->kind == ND_VLOOP) {
+    node->var->reg = NULL;
+  }
+
+  find_memory_params(node->lhs);
+  find_memory_params(node->rhs);
+  find_memory_params(node->cond);
+  find_memory_params(node->cons);
+  find_memory_params(node->alt);
+  find_memory_params(node->init);
+  find_memory_params(node->updt);
+  for (Node *n = node->body; n; n = n->next) {
+    find_memory_params(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    find_memory_params(n);
+  }
+}
+
+// Keeps read-only scalar parameters of a leaf function in registers instead
+// of storing them to the stack. The code of a function body uses no other
+// registers than RAX, RCX, RDX, RSI, RDI and R8, and with no calls, R9, R10
+// and R11 are preserved throughout it. R9 holds the sixth argument on entry,
+// which the prologue moves before the others.
+void assign_param_regs(Function *fn) {
+  fn->is_leaf = true;
+  for (Node *node = fn->node; node; node = node->next) {
+    if (has_call(node)) {
+      fn->is_leaf = false;
+      return;
+    }
+  }
+
+  // Give every scalar parameter a register first, and then hand out the
+  // registers in order to those which may stay in one
+  static char *regs[] = {"r9", "r10", "r11"};
+  for (VarList *vl = fn->params; vl; vl = vl->next) {
+    Type *type = vl->var->type;
+    if (is_integer(type) || type->kind == TYPE_PTR) {
+      vl->var->reg = regs[0];
+    }
+  }
+  for (Node *node = fn->node; node; node = node->next) {
+    find_memory_params(node);
+  }
+
+  int n = 0;
+  for (VarList *vl = fn->params; vl; vl = vl->next) {
+    if (vl->var->reg) {
+      vl->var->reg = n < 3 ? regs[n++] : NULL;
+    }
+  }
+}
+
+// Assigns offsets from RBP to local variables of a function, except for
+// parameters kept in registers.
+//
+// If the address of a local may be taken, pointer arithmetic may step from
+// one local to another, so variables are simply laid out in the order of
+// declaration in that case.
+void assign_frame_layout(Function *fn) {
+  assign_param_regs(fn);
+
+  for (Node *node = fn->node; node; node = node->next) {
+    if (may_escape_local(node)) {
+      int offset = 0;
+      for (VarList *vl = fn->locals; vl; vl = vl->next) {
+        Var *var = vl->var;
+        if (var->reg) {
+          continue;
+        }
+        offset = align_to(offset, var->type->align) + var->type->size;
+        var->offset = offset;
+      }
+      fn->stack_size = align_to(offset, 16);
+      return;
+    }
+  }
+
+  pack_locals(fn);
+}
+
+// Size of a cache line, which a hot member should not straddle
+#define CACHE_LINE 64
+
+// Prints a padding hole of `size` bytes at `offset`, if any.
+void print_hole(int offset, int size, char *what) {
+  if (size > 0) {
+    printf("  %6d %5d        (%s)\n", offset, size, what);
+  }
+}
+
+// Returns the size of a struct whose members are laid out in the given order.
+int struct_size(Member **members, int n, int align) {
+  int offset = 0;
+  for (int i = 0; i < n; i++) {
+    offset = align_to(offset, members[i]->type->align) + members[i]->type->size;
+  }
+  return align_to(offset, align);
+}
+
+// Suggests a member order which minimizes the size of a struct. Since sizes
+// are multiples of alignments, sorting members by alignment in descending
+// order leaves no holes between them.
+void suggest_member_order(Type *type, int n) {
+  Member **members = calloc(n, sizeof(Member *));
+  int i = 0;
+  for (Member *m = type->members; m; m = m->next) {
+    members[i++] = m;
+  }
+
+  // Insertion sort, which keeps the declaration order among members of the
+  // same alignment
+  for (int i = 1; i < n; i++) {
+    Member *m = members[i];
+    int j = i - 1;
+    for (; j >= 0 && members[j]->type->align < m->type->align; j--) {
+      members[j + 1] = members[j];
+    }
+    members[j + 1] = m;
+  }
+
+  int size = struct_size(members, n, type->align);
+  if (size == type->size) {
+    printf("  already in the smallest order\n");
+    return;
+  }
+
+  printf("  suggested order:");
+  for (int i = 0; i < n; i++) {
+    printf("%s %s", i ? "," : "", members[i]->name);
+  }
+  printf(" (size %d, saves %d bytes)\n", size, type->size - size);
+}
+
+// Prints the layout of a struct type along with its padding holes and
+// members straddling cache lines.
+void report_struct(Type *type) {
+  printf("struct %s: size %d, align %d\n",
+         type->name ? type->name : "<anonymous>", type->size, type->align);
+  printf("  %6s %5s %5s  %s\n", "offset", "size", "align", "member");
+
+  int n = 0;
+  int end = 0;
+  int padding = 0;
+  for (Member *m = type->members; m; m = m->next) {
+    print_hole(end, m->offset - end, "padding");
+    padding += m->offset - end;
+    printf("  %6d %5d %5d  %s\n", m->offset, m->type->size, m->type->align,
+           m->name);
+    end = m->offset + m->type->size;
+    n++;
+  }
+  print_hole(end, type->size - end, "tail padding");
+  padding += type->size - end;
+
+  if (type->size) {
+    printf("  padding: %d bytes (%d%% of size)\n", padding,
+           padding * 100 / type->size);
+  } else {
+    printf("  padding: 0 bytes\n");
+  }
+
+  // Offsets are relative to the start of the struct, which is assumed to be
+  // aligned to a cache line.
+  for (Member *m = type->members; m; m = m->next) {
+    int first = m->offset / CACHE_LINE;
+    int last = (m->offset + m->type->size - 1) / CACHE_LINE;
+    if (m->type->size && first != last) {
+      printf("  %s straddles cache lines %d-%d\n", m->name, first, last);
+    }
+  }
+
+  suggest_member_order(type, n);
+}
+
+// Prints a layout report of every struct type in a program.
+void report_struct_layout(Program *prog) {
+  for (TypeList *tl = prog->structs; tl; tl = tl->next) {
+    report_struct(tl->type);
+    if (tl->next) {
+      printf("\n");
+    }
+  }
+}
@@ -0,0 +1,422 @@
+#include "9cc.h"
+
+// Function being optimized
+Function *licm_fn;
+
+// Locals of `licm_fn` whose address is taken
+VarList *addr_taken;
+
+// Variables assigned in the loop being optimized, and whether the loop may
+// write to memory through a pointer or a function call
+VarList *assigned;
+bool writes_memory;
+
+// Invariant expressions hoisted out of the loop being optimized
+Node *hoisted;
+
+bool contains(VarList *vl, Var *var) {
+  for (; vl; vl = vl->next) {
+    if (vl->var == var) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void add_var(VarList **vl, Var *var) {
+  if (contains(*vl, var)) {
+    return;
+  }
+  VarList *v = calloc(1, sizeof(VarList));
+  v->var = var;
+  v->next = *vl;
+  *vl = v;
+}
+
+// Returns the variable an lvalue belongs to, or NULL if it is accessed
+// through a pointer.
+Var *root_var(Node *node) {
+  if (node->kind == ND_MEMBER) {
+    return root_var(node->lhs);
+  }
+  return node->kind == ND_VAR ? node->var : NULL;
+}
+
+// Collects variables whose address is taken in a tree.
+void find_addr_taken(Node *node) {
+  if (!node) {
+    return;
+  }
+
+  if (node->kind == ND_ADDR ||
+      (node->type && node->type->kind == TYPE_ARRAY)) {
+    Var *var = root_var(node->kind == ND_ADDR ? node->lhs : node);
+    if (var && var->is_local) {
+      add_var(&addr_taken, var);
+    }
+  }
+
+  find_addr_taken(node->lhs);
+  find_addr_taken(node->rhs);
+  find_addr_taken(node->cond);
+  find_addr_taken(node->cons);
+  find_addr_taken(node->alt);
+  find_addr_taken(node->init);
+  find_addr_taken(node->updt);
+  for (Node *n = node->body; n; n = n->next) {
+    find_addr_taken(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    find_addr_taken(n);
+  }
+}
+
+// Collects variables and memory modified in a tree.
+void find_writes(Node *node) {
+  if (!node) {
+    return;
+  }
+
+  if (node->kind == ND_ASSIGN || node->kind == ND_OP_ASSIGN) {
+    Var *var = root_var(node->lhs);
+    if (var) {
+      add_var(&assigned, var);
+    } else {
+      writes_memory = true;
+    }
+  }
+  if (node->kind == ND_MEMZERO) {
+    add_var(&assigned, node->lhs->var);
+  }
+  if (node->kind == ND_CALL) {
+    writes_memory = true;
+  }
+
+  find_writes(node->lhs);
+  find_writes(node->rhs);
+  find_writes(node->cond);
+  find_writes(node->cons);
+  find_writes(node->alt);
+  find_writes(node->init);
+  find_writes(node->updt);
+  for (Node *n = node->body; n; n = n->next) {
+    find_writes(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    find_writes(n);
+  }
+}
+
+// Returns true if the address of an lvalue doesn't change in the loop.
+bool is_invariant_addr(Node *node);
+
+// Returns true if an expression always evaluates to the same value in the
+// loop and can be evaluated before the loop without trapping. Memory loads
+// other than plain variables are never hoisted, since the loop may not run.
+bool is_invariant(Node *node) {
+  switch (node->kind) {
+  case ND_NUM:
+    return true;
+  case ND_VAR:
+    if (node->var->type->kind == TYPE_ARRAY) {
+      return true;
+    }
+    if (contains(assigned, node->var)) {
+      return false;
+    }
+    if (!node->var->is_local || contains(addr_taken, node->var)) {
+      return !writes_memory;
+    }
+    return true;
+  case ND_MEMBER:
+    // Only an array member evaluates to its address rather than a load
+    return node->type->kind == TYPE_ARRAY && is_invariant_addr(node->lhs);
+  case ND_ADDR:
+    return is_invariant_addr(node->lhs);
+  case ND_CAST:
+    return is_invariant(node->lhs);
+  case ND_DIV:
+    if (node->rhs->kind != ND_NUM || node->rhs->val == 0) {
+      return false;
+    }
+    return is_invariant(node->lhs);
+  case ND_ADD:
+  case ND_PTR_ADD:
+  case ND_SUB:
+  case ND_PTR_SUB:
+  case ND_PTR_DIFF:
+  case ND_MUL:
+  case ND_EQ:
+  case ND_NE:
+  case ND_LT:
+  case ND_LE:
+    return is_invariant(node->lhs) && is_invariant(node->rhs);
+  default:
+    return false;
+  }
+}
+
+bool is_invariant_addr(Node *node) {
+  switch (node->kind) {
+  case ND_VAR:
+    return true;
+  case ND_MEMBER:
+    return is_invariant_addr(node->lhs);
+  case ND_DEREF:
+    return is_invariant(node->lhs);
+  default:
+    return false;
+  }
+}
+
+// Returns true if hoisting an expression saves more than it costs, i.e. it
+// is more than a load of a variable or a constant.
+bool is_worth_hoisting(Node *node) {
+  switch (node->kind) {
+  case ND_NUM:
+  case ND_VAR:
+    return false;
+  case ND_ADDR:
+    return node->lhs->kind != ND_VAR;
+  default:
+    return true;
+  }
+}
+
+// Replaces an invariant expression with a new temporary variable, which is
+// initialized before the loop.
+Node *hoist(Node *node) {
+  Type *type = node->type;
+  if (type->kind == TYPE_ARRAY) {
+    type = pointer_to(type->base);
+  }
+
+  Var *var = new_object(OBJ_VAR, sizeof(Var));
+  var->name = "licm.tmp";
+  var->type = type;
+  var->is_local = true;
+  VarList *vl = calloc(1, sizeof(VarList));
+  vl->var = var;
+  vl->next = licm_fn->locals;
+  licm_fn->locals = vl;
+
+  Node *lhs = new_object(OBJ_NODE, sizeof(Node));
+  lhs->kind = ND_VAR;
+  lhs->tok = node->tok;
+  lhs->type = type;
+  lhs->var = var;
+
+  Node *assign = new_object(OBJ_NODE, sizeof(Node));
+  assign->kind = ND_ASSIGN;
+  assign->tok = node->tok;
+  assign->type = type;
+  assign->lhs = lhs;
+  assign->rhs = node;
+
+  Node *stmt = new_object(OBJ_NODE, sizeof(Node));
+  stmt->kind = ND_EXPR_STMT;
+  stmt->tok = node->tok;
+  stmt->lhs = assign;
+  stmt->next = hoisted;
+  hoisted = stmt;
+
+  Node *ref = new_object(OBJ_NODE, sizeof(Node));
+  *ref = *lhs;
+  return ref;
+}
+
+void hoist_lvalue(Node *node);
+
+// Hoists invariant subexpressions of an expression evaluated for its value.
+Node *hoist_value(Node *node) {
+  if (!node) {
+    return NULL;
+  }
+
+  Node *next = node->next;
+  if (node->type && node->type->kind != TYPE_STRUCT && is_invariant(node) &&
+      is_worth_hoisting(node)) {
+    Node *ref = hoist(node);
+    ref->next = next;
+    node->next = NULL;
+    return ref;
+  }
+
+  switch (node->kind) {
+  case ND_ADDR:
+  case ND_MEMBER:
+    hoist_lvalue(node->kind == ND_ADDR ? node->lhs : node);
+    return node;
+  case ND_ASSIGN:
+  case ND_OP_ASSIGN:
+    hoist_lvalue(node->lhs);
+    node->rhs = hoist_value(node->rhs);
+    return node;
+  case ND_STMT_EXPR:
+  case ND_INLINE:
+    // Statements in these are handled by the enclosing loop's walk
+    return node;
+  default:
+    break;
+  }
+
+  node->lhs = hoist_value(node->lhs);
+  node->rhs = hoist_value(node->rhs);
+  Node head = {};
+  Node *cur = &head;
+  for (Node *n = node->args; n;) {
+    Node *next = n->next;
+    cur->next = hoist_value(n);
+    cur = cur->next;
+    n = next;
+  }
+  node->args = head.next;
+  return node;
+}
+
+// Hoists invariant subexpressions of an lvalue without replacing the lvalue
+// itself.
+void hoist_lvalue(Node *node) {
+  switch (node->kind) {
+  case ND_MEMBER:
+    hoist_lvalue(node->lhs);
+    return;
+  case ND_DEREF:
+    node->lhs = hoist_value(node->lhs);
+    return;
+  default:
+    return;
+  }
+}
+
+void optimize_stmt(Node *node);
+
+// Hoists invariant expressions in statements of a loop body.
+void hoist_stmt(Node *node) {
+  if (!node) {
+    return;
+  }
+
+  switch (node->kind) {
+  case ND_EXPR_STMT:
+  case ND_RETURN:
+  case ND_INLINE_RET:
+    node->lhs = hoist_value(node->lhs);
+    if (node->lhs->kind == ND_STMT_EXPR || node->lhs->kind == ND_INLINE) {
+      for (Node *n = node->lhs->body; n; n = n->next) {
+        hoist_stmt(n);
+      }
+    }
+    return;
+  case ND_IF:
+  case ND_SWITCH:
+    node->cond = hoist_value(node->cond);
+    hoist_stmt(node->cons);
+    hoist_stmt(node->alt);
+    return;
+  case ND_CASE:
+    hoist_stmt(node->lhs);
+    return;
+  case ND_WHILE:
+  case ND_FOR:
+    // Inner loops have already been optimized on their own
+    hoist_stmt(node->init);
+    return;
+  case ND_BLOCK:
+    for (Node *n = node->body; n; n = n->next) {
+      hoist_stmt(n);
+    }
+    return;
+  default:
+    return;
+  }
+}
+
+// Hoists loop-invariant expressions out of a "while" or "for" loop. The loop
+// node is turned into a block which evaluates the invariants into temporaries
+// after the loop initialization and then runs the loop. A loop that a
+// "switch" can jump into is left alone, since that would skip the preheader.
+void optimize_loop(Node *node) {
+  if (has_case_label(node->cons)) {
+    return;
+  }
+
+  assigned = NULL;
+  writes_memory = false;
+  find_writes(node->cond);
+  find_writes(node->cons);
+  find_writes(node->updt);
+
+  hoisted = NULL;
+  if (node->cond) {
+    node->cond = hoist_value(node->cond);
+  }
+  hoist_stmt(node->cons);
+  hoist_stmt(node->updt);
+  if (!hoisted) {
+    return;
+  }
+
+  // Move the loop to a new node and put the preheader in front of it
+  Node *loop = new_object(OBJ_NODE, sizeof(Node));
+  *loop = *node;
+  loop->next = NULL;
+  loop->init = NULL;
+
+  Node *last = hoisted;
+  while (last->next) {
+    last = last->next;
+  }
+  last->next = loop;
+
+  node->kind = ND_BLOCK;
+  node->body = hoisted;
+  node->cond = node->cons = node->updt = NULL;
+  if (node->init) {
+    node->init->next = hoisted;
+    node->body = node->init;
+    node->init = NULL;
+  }
+}
+
+// Optimizes loops in a statement, innermost first.
+void optimize_stmt(Node *node) {
+  if (!node) {
+    return;
+  }
+
+  optimize_stmt(node->lhs);
+  optimize_stmt(node->rhs);
+  optimize_stmt(node->cons);
+  optimize_stmt(node->alt);
+  for (Node *n = node->body; n; n = n->next) {
+    optimize_stmt(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    optimize_stmt(n);
+  }
+
+  if (node->kind == ND_WHILE || node->kind == ND_FOR) {
+    optimize_loop(node);
+  }
+}
+
+// Moves loop-invariant computations of a function out of "while" and "for"
+// loops.
+void licm_function(Function *fn) {
+  licm_fn = fn;
+  addr_taken = NULL;
+  for (Node *node = fn->node; node; node = node->next) {
+    find_addr_taken(node);
+  }
+  for (Node *node = fn->node; node; node = node->next) {
+    optimize_stmt(node);
+  }
+}
+
+// Moves loop-invariant computations out of "while" and "for" loops.
+void hoist_loop_invariants(Program *prog) {
+  for (Function *fn = prog->fns; fn; fn = fn->next) {
+    licm_function(fn);
+  }
+}
@@ -1,5 +1,41 @@
 #include "9cc.h"
 
+// Maximum number of AST nodes in a function body to be inlined
+int inline_limit = 16;
+
+// If true, vectorize loops over arrays, using AVX2 instead of SSE2 if
+// `use_avx2` is true
+bool vectorize = true;
+bool use_avx2;
+
+// If true, report struct layouts instead of generating assembly
+bool layout_report;
+
+// Paths of the profile to be dumped by an instrumented program and of the
+// profile to optimize with, or NULL if not given
+char *profile_generate;
+char *profile_use;
+
+// If true, count calls and cycles of each function
+bool instrument_functions;
+
+// If true, emit DWARF line numbers
+bool debug_info;
+
+// If true, generate position-independent code for shared libraries and PIE
+bool pic;
+
+// If true, leaf functions set up no frame pointer
+bool omit_frame_pointer = true;
+
+// If true, compile one function at a time, freeing its AST once emitted
+bool streaming;
+
+// If true, print compile time and memory statistics, in JSON if
+// `stats_json` is true
+bool stats;
+bool stats_json;
+
 char *read_file(char *path) {
   // Open and read the file
   FILE *fp = fopen(path, "r");
@@ -23,30 +59,266 @@ char *read_file(char *path) {
   return buf;
 }
 
-int main(int argc, char **argv) {
-  if (argc != 2) {
-    error("%s: invalid number of arguments", argv[0]);
+void usage(char *argv0) {
+  error("usage: %s [-g] [-finline-limit=N] [-fno-inline] [-fno-vectorize] "
+        "[-fconstexpr-steps=N] [-mavx2] [-fprofile-generate[=path]] "
+        "[-fprofile-use[=path]] [-finstrument-functions-lite] "
+        "[-fno-omit-frame-pointer] [-fPIC] [-fPIE] [--stats[=json]] "
+        "[--streaming] [--layout-report] <file>",
+        argv0);
+}
+
+// Parses command line options and sets the input file name.
+void parse_args(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    char *arg = argv[i];
+
+    if (!strcmp(arg, "-g")) {
+      debug_info = true;
+      continue;
+    }
+    if (!strncmp(arg, "-finline-limit=", 15)) {
+      inline_limit = atoi(arg + 15);
+      continue;
+    }
+    if (!strcmp(arg, "-fPIC") || !strcmp(arg, "-fpic") ||
+        !strcmp(arg, "-fPIE") || !strcmp(arg, "-fpie")) {
+      pic = true;
+      continue;
+    }
+    if (!strncmp(arg, "-fconstexpr-steps=", 18)) {
+      constexpr_steps = atoi(arg + 18);
+      continue;
+    }
+    if (!strcmp(arg, "-fno-omit-frame-pointer")) {
+      omit_frame_pointer = false;
+      continue;
+    }
+    if (!strcmp(arg, "-fno-inline")) {
+      inline_limit = 0;
+      continue;
+    }
+    if (!strcmp(arg, "-fno-vectorize")) {
+      vectorize = false;
+      continue;
+    }
+    if (!strcmp(arg, "-mavx2")) {
+      use_avx2 = true;
+      continue;
+    }
+    if (!strncmp(arg, "-fprofile-generate", 18) &&
+        (arg[18] == '\0' || arg[18] == '=')) {
+      profile_generate = arg[18] ? arg + 19 : "";
+      continue;
+    }
+    if (!strncmp(arg, "-fprofile-use", 13) &&
+        (arg[13] == '\0' || arg[13] == '=')) {
+      profile_use = arg[13] ? arg + 14 : "";
+      continue;
+    }
+    if (!strcmp(arg, "-finstrument-functions-lite")) {
+      instrument_functions = true;
+      continue;
+    }
+    if (!strcmp(arg, "--stats")) {
+      stats = true;
+      continue;
+    }
+    if (!strcmp(arg, "--stats=json")) {
+      stats = stats_json = true;
+      continue;
+    }
+    if (!strcmp(arg, "--streaming")) {
+      streaming = true;
+      continue;
+    }
+    if (!strcmp(arg, "--layout-report")) {
+      layout_report = true;
+      continue;
+    }
+    if (arg[0] == '-') {
+      error("unknown option: %s", arg);
+    }
+
+    if (filename) {
+      usage(argv[0]);
+    }
+    filename = arg;
+  }
+
+  if (!filename) {
+    usage(argv[0]);
+  }
+  if (streaming && (profile_use || layout_report)) {
+    error("--streaming cannot be used with -fprofile-use or --layout-report");
+  }
+
+  // The profile defaults to the source file name with ".prof" appended
+  char *path = calloc(strlen(filename) + 6, 1);
+  sprintf(path, "%s.prof", filename);
+  if (profile_generate && !*profile_generate) {
+    profile_generate = path;
+  }
+  if (profile_use && !*profile_use) {
+    profile_use = path;
   }
+}
+
+// Frees the local variables of a function which has been emitted. The
+// Function itself is kept, as calls to it still refer to it.
+void free_locals(Function *fn) {
+  for (VarList *vl = fn->locals; vl;) {
+    VarList *next = vl->next;
+    free(vl->var);
+    free(vl);
+    vl = next;
+  }
+  for (VarList *vl = fn->params; vl;) {
+    VarList *next = vl->next;
+    free(vl);
+    vl = next;
+  }
+  fn->node = NULL;
+  fn->locals = NULL;
+  fn->params = NULL;
+  fn->tok = NULL;
+}
+
+// Frees the tokens from `tok` up to but not including `end`.
+void free_tokens(Token *tok, Token *end) {
+  while (tok != end) {
+    Token *next = tok->next;
+    free(tok);
+    tok = next;
+  }
+}
+
+// Compiles the input one function at a time: each function is tokenized,
+// parsed, optimized and emitted, and its tokens, AST and local variables are
+// freed before the next one is tokenized. Global variables and string literals are
+// emitted at the end. Only functions defined earlier can be inlined or
+// evaluated at compile time, and unused symbols are kept.
+void compile_streaming() {
+  // Copies of the functions which may be inlined into later ones
+  Program *inlinable = new_program(NULL);
+
+  begin_codegen();
+  token = tokenize_function();
+  for (;;) {
+    Token *start = token;
+    begin_region();
+    Function *fn = next_function();
+    if (!fn) {
+      release_region();
+      break;
+    }
+    if (profile_generate) {
+      assign_function_counters(fn);
+    }
+
+    consteval_function(inlinable, fn);
+    inline_function(inlinable, fn);
+    bool retained = is_inline_candidate(fn);
+    if (retained) {
+      end_region();
+      Function *copy = copy_for_inlining(fn);
+      copy->next = inlinable->fns;
+      inlinable->fns = copy;
+      begin_region();
+    }
+
+    dce_function(fn);
+    licm_function(fn);
+    if (vectorize) {
+      vectorize_function(fn);
+    }
+    assign_frame_layout(fn);
+    emit_function(fn);
+
+    release_region();
+    free_locals(fn);
+    if (!retained) {
+      free_tokens(start, token);
+    }
+
+    // Replace the end of this function's tokens by those of the next one
+    Token *end = token;
+    token = tokenize_function();
+    free(end);
+  }
+  end_phase("compile");
+
+  end_codegen(new_program(NULL));
+  fflush(stdout);
+  end_phase("codegen");
+}
+
+int main(int argc, char **argv) {
+  parse_args(argc, argv);
+  start_phases();
 
   // Tokenize and parse input
-  filename = argv[1];
   user_input = read_file(filename);
+  end_phase("read_file");
+
+  if (streaming) {
+    compile_streaming();
+    if (stats) {
+      print_stats(stats_json);
+    }
+    return 0;
+  }
+
   token = tokenize();
+  end_phase("tokenize");
   Program *prog = program();
+  end_phase("program");
+
+  if (layout_report) {
+    report_struct_layout(prog);
+    end_phase("layout_report");
+    if (stats) {
+      print_stats(stats_json);
+    }
+    return 0;
+  }
+
+  if (profile_generate || profile_use) {
+    assign_profile_counters(prog);
+  }
+  if (profile_use) {
+    read_profile(prog, profile_use);
+  }
+  end_phase("profile");
+
+  // Replace calls to pure functions with constant arguments by their results
+  // and calls to small functions with their bodies
+  consteval_calls(prog);
+  end_phase("consteval");
+  inline_functions(prog);
+  end_phase("inline");
+  eliminate_dead_code(prog);
+  end_phase("dead_code");
+  hoist_loop_invariants(prog);
+  end_phase("licm");
+  if (vectorize) {
+    vectorize_loops(prog);
+  }
+  end_phase("vectorize");
 
   // Assign offsets to local variables
   for (Function *fn = prog->fns; fn; fn = fn->next) {
-    int offset = 0;
-    for (VarList *vl = fn->locals; vl; vl = vl->next) {
-      Var *var = vl->var;
-      offset = align_to(offset, var->type->align) + var->type->size;
-      var->offset = offset;
-    }
-    fn->stack_size = align_to(offset, 8);
+    assign_frame_layout(fn);
   }
+  end_phase("frame_layout");
 
   // Generate assembly with traversing the AST
   codegen(prog);
+  fflush(stdout);
+  end_phase("codegen");
 
+  if (stats) {
+    print_stats(stats_json);
+  }
   return 0;
 }
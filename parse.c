@@ -1,12 +1,13 @@
 #include "9cc.h"
 
-// Scope for local variables, global variables and typedefs
+// Scope for local variables, global variables, typedefs and functions
 typedef struct VarScope VarScope;
 struct VarScope {
   VarScope *next;
   char *name;
   Var *var;
   Type *type_def;
+  Function *func;
 };
 
 // Scope for struct tags
@@ -20,6 +21,7 @@ struct TagScope {
 typedef struct {
   VarScope *var_scope;
   TagScope *tag_scope;
+  int seq; // Sequence number of the enclosing block scope
 } Scope;
 
 // All local and global variable instances created during parsing are
@@ -27,23 +29,72 @@ typedef struct {
 VarList *locals;
 VarList *globals;
 
+// Struct types defined in the program, most recent first
+TypeList *structs;
+
 // C has two block scopes; one is for variables/typedefs and the other is for
 // struct tags.
 VarScope *var_scope;
 TagScope *tag_scope;
 
+// Block scopes are numbered in the order they are opened, so the blocks
+// nested in a block get numbers between the block's own number and the last
+// number issued before it is closed. Local variables record this range as
+// their lifetime.
+int scope_seq;
+int cur_scope;
+
+// Value of a "case" label
+typedef struct CaseVal CaseVal;
+struct CaseVal {
+  CaseVal *next;
+  long val;
+};
+
+// "switch" statement being parsed
+typedef struct Switch Switch;
+struct Switch {
+  Switch *outer;
+  Type *type;    // Promoted type of the controlling expression
+  CaseVal *vals; // Values of the "case" labels seen so far
+  bool has_default;
+};
+
+Switch *cur_switch;
+
+// Number of enclosing statements which "break" can jump out of
+int break_targets;
+
 // Begins a block scope.
 Scope *enter_scope() {
   Scope *sc = calloc(1, sizeof(Scope));
   sc->var_scope = var_scope;
   sc->tag_scope = tag_scope;
+  sc->seq = cur_scope;
+  cur_scope = ++scope_seq;
   return sc;
 }
 
-// Ends the block scope.
+// Ends the block scope, freeing the scope entries declared in it.
 void leave_scope(Scope *sc) {
+  for (VarScope *v = var_scope; v != sc->var_scope;) {
+    VarScope *next = v->next;
+    if (v->var && v->var->is_local) {
+      v->var->scope_end = scope_seq;
+    }
+    free(v);
+    v = next;
+  }
+  for (TagScope *t = tag_scope; t != sc->tag_scope;) {
+    TagScope *next = t->next;
+    free(t);
+    t = next;
+  }
+
   var_scope = sc->var_scope;
   tag_scope = sc->tag_scope;
+  cur_scope = sc->seq;
+  free(sc);
 }
 
 // Finds a variable or a typedef by name. If a variable with the name is not
@@ -72,7 +123,7 @@ TagScope *find_tag(Token *tok) {
 }
 
 Node *new_node(NodeKind kind, Token *tok) {
-  Node *node = calloc(1, sizeof(Node));
+  Node *node = new_object(OBJ_NODE, sizeof(Node));
   node->kind = kind;
   node->tok = tok;
   return node;
@@ -91,14 +142,14 @@ Node *new_binary(NodeKind kind, Node *lhs, Node *rhs, Token *tok) {
   return node;
 }
 
-Node *new_num(int val, Token *tok) {
+Node *new_num(long val, Token *tok) {
   Node *node = new_node(ND_NUM, tok);
   node->val = val;
   return node;
 }
 
 VarScope *push_scope(char *name) {
-  VarScope *sc = calloc(1, sizeof(VarScope));
+  VarScope *sc = new_object(OBJ_SCOPE, sizeof(VarScope));
   sc->name = name;
   sc->next = var_scope;
   var_scope = sc;
@@ -115,7 +166,7 @@ VarList *new_var_list(Var *var) {
 // Creates a new local or global variable with the given name, based on
 // `is_local` flag.
 Var *new_var(char *name, Type *type, bool is_local) {
-  Var *var = calloc(1, sizeof(Var));
+  Var *var = new_object(OBJ_VAR, sizeof(Var));
   var->name = name;
   var->type = type;
   var->is_local = is_local;
@@ -125,6 +176,7 @@ Var *new_var(char *name, Type *type, bool is_local) {
 // Creates a new local variable with the given name.
 Var *new_local_var(char *name, Type *type) {
   Var *var = new_var(name, type, true);
+  var->scope_begin = cur_scope;
   push_scope(name)->var = var;
 
   VarList *vl = new_var_list(var);
@@ -178,6 +230,8 @@ Node *stmt_inner();
 Node *declaration();
 Node *expr();
 Node *assign();
+Node *new_add(Node *lhs, Node *rhs, Token *tok);
+Node *new_sub(Node *lhs, Node *rhs, Token *tok);
 Node *equality();
 Node *relational();
 Node *add();
@@ -192,39 +246,123 @@ Node *func_args();
 // by looking ahead input tokens.
 bool is_function() {
   Token *tok = token;
+  TypeList *sl = structs;
+  consume("static");
+  consume("extern");
   basetype();
   bool is_func = consume_ident() && consume("(");
   token = tok;
+  structs = sl;
   return is_func;
 }
 
+// Parses global variables and function prototypes up to the next function
+// definition and returns it, or NULL at the end of input.
+Function *next_function() {
+  while (!at_eof()) {
+    if (!is_function()) {
+      global_var();
+      continue;
+    }
+    Function *fn = function();
+    if (fn) {
+      return fn;
+    }
+  }
+  return NULL;
+}
+
 // program = (global-var | function)*
 Program *program() {
   Function head = {};
   Function *cur = &head;
-  globals = NULL;
-
-  while (!at_eof()) {
-    if (is_function()) {
-      cur->next = function();
-      cur = cur->next;
-    } else {
-      global_var();
-    }
+  for (Function *fn = next_function(); fn; fn = next_function()) {
+    cur->next = fn;
+    cur = cur->next;
   }
+  return new_program(head.next);
+}
 
+// Creates a program of the given functions and all global variables and
+// struct types parsed so far.
+Program *new_program(Function *fns) {
   Program *prog = calloc(1, sizeof(Program));
   prog->globals = globals;
-  prog->fns = head.next;
+  prog->fns = fns;
+
+  // Struct types are pushed to the list in reverse order. The list is
+  // copied, since a program may be created more than once while parsing.
+  for (TypeList *tl = structs; tl; tl = tl->next) {
+    TypeList *copy = calloc(1, sizeof(TypeList));
+    copy->type = tl->type;
+    copy->next = prog->structs;
+    prog->structs = copy;
+  }
   return prog;
 }
 
+// Returns true if the next token is a keyword of a builtin integer type.
+bool is_builtin_type() {
+  return peek("char") || peek("short") || peek("int") || peek("long") ||
+         peek("signed") || peek("unsigned");
+}
+
 // Returns true if the next token represents a type.
 bool is_type_name(Token *tok) {
-  return peek("char") || peek("int") || peek("struct") || find_typedef(token);
+  return is_builtin_type() || peek("struct") || find_typedef(token);
+}
+
+// builtin-type = ("char" | "short" | "int" | "long" | "signed" | "unsigned")+
+//
+// The keywords may appear in any order, e.g. "long unsigned int", as long as
+// they make one of the integer types.
+Type *builtin_type() {
+  Token *tok = token;
+  int n_char = 0;
+  int n_short = 0;
+  int n_int = 0;
+  int n_long = 0;
+  int n_signed = 0;
+  int n_unsigned = 0;
+
+  for (;;) {
+    if (consume("char")) {
+      n_char++;
+    } else if (consume("short")) {
+      n_short++;
+    } else if (consume("int")) {
+      n_int++;
+    } else if (consume("long")) {
+      n_long++;
+    } else if (consume("signed")) {
+      n_signed++;
+    } else if (consume("unsigned")) {
+      n_unsigned++;
+    } else {
+      break;
+    }
+  }
+
+  if (n_char > 1 || n_short > 1 || n_int > 1 || n_long > 2 ||
+      n_signed + n_unsigned > 1 || n_char + n_short + !!n_long > 1 ||
+      (n_char && n_int)) {
+    error_tok(tok, "invalid type");
+  }
+
+  bool u = n_unsigned;
+  if (n_char) {
+    return u ? uchar_type : char_type;
+  }
+  if (n_short) {
+    return u ? ushort_type : short_type;
+  }
+  if (n_long) {
+    return u ? ulong_type : long_type;
+  }
+  return u ? uint_type : int_type;
 }
 
-// basetype = ("char" | "int" | struct-decl | typedef-name) "*"*
+// basetype = (builtin-type | struct-decl | typedef-name) "*"*
 Type *basetype() {
   if (!is_type_name(token)) {
     error_tok(token, "unknown type name");
@@ -232,10 +370,8 @@ Type *basetype() {
 
   // Parse type name
   Type *type;
-  if (consume("char")) {
-    type = char_type;
-  } else if (consume("int")) {
-    type = int_type;
+  if (is_builtin_type()) {
+    type = builtin_type();
   } else if (consume("struct")) {
     type = struct_decl();
   } else {
@@ -251,7 +387,7 @@ Type *basetype() {
 }
 
 void push_tag_scope(Token *tok, Type *type) {
-  TagScope *sc = calloc(1, sizeof(TagScope));
+  TagScope *sc = new_object(OBJ_SCOPE, sizeof(TagScope));
   sc->next = tag_scope;
   sc->name = strndup(tok->str, tok->len);
   sc->type = type;
@@ -281,7 +417,7 @@ Type *struct_decl() {
     cur = cur->next;
   }
 
-  Type *type = calloc(1, sizeof(Type));
+  Type *type = new_object(OBJ_TYPE, sizeof(Type));
   type->kind = TYPE_STRUCT;
   type->members = head.next;
 
@@ -300,9 +436,15 @@ Type *struct_decl() {
 
   // Register the struct type if a name is given
   if (tag) {
+    type->name = strndup(tag->str, tag->len);
     push_tag_scope(tag, type);
   }
 
+  TypeList *tl = calloc(1, sizeof(TypeList));
+  tl->type = type;
+  tl->next = structs;
+  structs = tl;
+
   return type;
 }
 
@@ -328,55 +470,303 @@ Member *struct_member() {
   return m;
 }
 
-// global-var = basetype ident ("[" num "]")* ";"
+// Consumes the end of an initializer list, which may have a trailing comma,
+// or the comma before the next element. Returns true at the end of the list.
+bool consume_end() {
+  if (consume("}")) {
+    return true;
+  }
+  expect(",");
+  return consume("}");
+}
+
+long eval2(Node *node, Var **var);
+
+// Evaluates the address of an lvalue in a constant expression.
+long eval_addr(Node *node, Var **var) {
+  switch (node->kind) {
+  case ND_VAR:
+    if (!var || node->var->is_local) {
+      error_tok(node->tok, "not a compile-time constant");
+    }
+    *var = node->var;
+    return 0;
+  case ND_MEMBER:
+    return eval_addr(node->lhs, var) + node->member->offset;
+  case ND_DEREF:
+    return eval2(node->lhs, var);
+  default:
+    break;
+  }
+  error_tok(node->tok, "not a compile-time constant");
+  return 0;
+}
+
+long eval(Node *node) { return eval2(node, NULL); }
+
+// Evaluates a constant expression. If the value is the address of a global
+// variable plus an offset, the variable is returned via `var`, which may be
+// NULL only if the expression must be an integer. Integer operators are
+// folded like the generated code computes them.
+long eval2(Node *node, Var **var) {
+  switch (node->kind) {
+  case ND_NUM:
+    return node->val;
+  case ND_CAST:
+    return extend_const(eval2(node->lhs, var), node->type);
+  case ND_ADD:
+  case ND_SUB:
+  case ND_MUL:
+  case ND_DIV:
+  case ND_EQ:
+  case ND_NE:
+  case ND_LT:
+  case ND_LE: {
+    long val;
+    if (!fold_binary(node, eval(node->lhs), eval(node->rhs), &val)) {
+      error_tok(node->tok, "division by zero");
+    }
+    return val;
+  }
+  case ND_PTR_ADD:
+    return eval2(node->lhs, var) + eval(node->rhs) * node->type->base->size;
+  case ND_PTR_SUB:
+    return eval2(node->lhs, var) - eval(node->rhs) * node->type->base->size;
+  case ND_ADDR:
+    return eval_addr(node->lhs, var);
+  case ND_VAR:
+  case ND_MEMBER:
+    // An array evaluates to its address
+    if (node->type->kind == TYPE_ARRAY) {
+      return eval_addr(node, var);
+    }
+    break;
+  default:
+    break;
+  }
+  error_tok(node->tok, "not a compile-time constant");
+  return 0;
+}
+
+// Appends `size` bytes holding `val` to a global variable's contents.
+Initializer *new_init_val(Initializer *cur, int size, long val) {
+  Initializer *init = calloc(1, sizeof(Initializer));
+  init->size = size;
+  init->val = val;
+  cur->next = init;
+  return init;
+}
+
+// Appends `size` zero bytes, if any, to a global variable's contents.
+Initializer *new_init_zero(Initializer *cur, int size) {
+  return size > 0 ? new_init_val(cur, size, 0) : cur;
+}
+
+// Appends the address of `var` plus `addend` to a global variable's contents.
+Initializer *new_init_label(Initializer *cur, Var *var, long addend) {
+  Initializer *init = new_init_val(cur, 8, addend);
+  init->label = var;
+  return init;
+}
+
+// initializer = "{" (initializer ("," initializer)* ","?)? "}"
+//             | str
+//             | assign
+//
+// Reads the initializer of a global variable of `type` and appends its
+// contents, in which omitted elements and padding are zero.
+Initializer *gvar_initializer(Initializer *cur, Type *type) {
+  Token *tok = token;
+
+  if (type->kind == TYPE_ARRAY && type->base->kind == TYPE_CHAR &&
+      tok->kind == TK_STR) {
+    token = token->next;
+    if (tok->cont_len - 1 > type->array_len) {
+      error_tok(tok, "initializer-string is too long");
+    }
+    int len = tok->cont_len < type->array_len ? tok->cont_len : type->array_len;
+    for (int i = 0; i < len; i++) {
+      cur = new_init_val(cur, 1, tok->contents[i]);
+    }
+    return new_init_zero(cur, type->array_len - len);
+  }
+
+  if (type->kind == TYPE_ARRAY) {
+    expect("{");
+    int i = 0;
+    if (!consume("}")) {
+      do {
+        if (i == type->array_len) {
+          error_tok(token, "excess elements in array initializer");
+        }
+        cur = gvar_initializer(cur, type->base);
+        i++;
+      } while (!consume_end());
+    }
+    return new_init_zero(cur, type->base->size * (type->array_len - i));
+  }
+
+  if (type->kind == TYPE_STRUCT) {
+    expect("{");
+    int offset = 0;
+    Member *mem = type->members;
+    if (!consume("}")) {
+      do {
+        if (!mem) {
+          error_tok(token, "excess elements in struct initializer");
+        }
+        cur = new_init_zero(cur, mem->offset - offset);
+        cur = gvar_initializer(cur, mem->type);
+        offset = mem->offset + mem->type->size;
+        mem = mem->next;
+      } while (!consume_end());
+    }
+    return new_init_zero(cur, type->size - offset);
+  }
+
+  // A scalar may be enclosed in braces
+  if (consume("{")) {
+    cur = gvar_initializer(cur, type);
+    consume(",");
+    expect("}");
+    return cur;
+  }
+
+  Node *expr = assign();
+  add_type(expr);
+  Var *var = NULL;
+  long addend = eval2(expr, &var);
+  if (!var) {
+    return new_init_val(cur, type->size, extend_const(addend, type));
+  }
+  if (type->size != 8) {
+    error_tok(tok, "initializer element is not computable at load time");
+  }
+  return new_init_label(cur, var, addend);
+}
+
+// global-var = ("static" | "extern")? basetype ident ("[" num "]")*
+//              ("=" initializer)? ";"
 void global_var() {
+  // Global variables are not exported anyway
+  consume("static");
+  bool is_extern = consume("extern");
   Type *type = basetype();
   char *name = expect_ident();
   type = read_type_suffix(type);
+  Var *var = new_global_var(name, type);
+
+  if (consume("=")) {
+    Initializer head = {};
+    gvar_initializer(&head, type);
+    var->initializer = head.next;
+  } else {
+    var->is_extern = is_extern;
+  }
   expect(";");
-  new_global_var(name, type);
 }
 
 VarList *read_func_param() {
   Type *type = basetype();
+  Token *tok = token;
   char *name = expect_ident();
   type = read_type_suffix(type);
+  if (type->kind == TYPE_STRUCT) {
+    error_tok(tok, "passing a struct by value is not supported");
+  }
   return new_var_list(new_local_var(name, type));
 }
 
-// Reads function parameters and returns a list of them.
-VarList *read_func_params() {
+// Reads function parameters into `fn`.
+void read_func_params(Function *fn) {
   if (consume(")")) {
-    return NULL;
+    return;
   }
 
-  VarList *head = read_func_param();
-  VarList *cur = head;
+  fn->params = read_func_param();
+  fn->n_params = 1;
+  VarList *cur = fn->params;
 
   while (!consume(")")) {
     expect(",");
+    if (consume("...")) {
+      fn->is_variadic = true;
+      expect(")");
+      return;
+    }
+
     cur->next = read_func_param();
     cur = cur->next;
+    fn->n_params++;
   }
+}
 
-  return head;
+// Returns true if two declarations of a function agree on its type.
+bool is_same_func_type(Function *fn1, Function *fn2) {
+  if (fn1->n_params != fn2->n_params ||
+      fn1->is_variadic != fn2->is_variadic ||
+      !is_same_type(fn1->return_type, fn2->return_type)) {
+    return false;
+  }
+  TypeList *t1 = fn1->param_types;
+  TypeList *t2 = fn2->param_types;
+  for (; t1 && t2; t1 = t1->next, t2 = t2->next) {
+    if (!is_same_type(t1->type, t2->type)) {
+      return false;
+    }
+  }
+  return true;
 }
 
-// function = basetype ident "(" params? ")" "{" stmt* "}"
-// params   = param ("," param)*
+// function = ("static" | "extern")? basetype ident "(" params? ")"
+//            ("{" stmt* "}" | ";")
+// params   = param ("," param)* ("," "...")?
 // param    = basetype ident
 Function *function() {
   // Initialie a list of local variables
   locals = NULL;
 
   // Start parsing a function
-  basetype();
-  char *name = expect_ident();
+  Function *fn = calloc(1, sizeof(Function));
+  fn->is_static = consume("static");
+  consume("extern");
+  fn->return_type = basetype();
+  Token *tok = token;
+  if (fn->return_type->kind == TYPE_STRUCT) {
+    error_tok(tok, "returning a struct by value is not supported");
+  }
+  fn->tok = tok;
+  fn->name = expect_ident();
+
+  // Register the function before parsing its body so that it can call itself
+  VarScope *prev = find_var(tok);
+  push_scope(fn->name)->func = fn;
 
   // Parse function arguments
   expect("(");
   Scope *sc = enter_scope();
-  VarList *params = read_func_params();
+  read_func_params(fn);
+
+  // Parameter types outlive the parameters, which are freed under --streaming
+  TypeList types = {};
+  TypeList *ty = &types;
+  for (VarList *vl = fn->params; vl; vl = vl->next) {
+    ty->next = calloc(1, sizeof(TypeList));
+    ty = ty->next;
+    ty->type = vl->var->type;
+  }
+  fn->param_types = types.next;
+
+  // A redeclaration must agree with the previous declaration
+  if (prev && prev->func && !is_same_func_type(prev->func, fn)) {
+    error_tok(tok, "conflicting types for '%s'", fn->name);
+  }
+
+  // A function prototype has no body
+  if (consume(";")) {
+    leave_scope(sc);
+    return NULL;
+  }
 
   // Parse function body
   expect("{");
@@ -388,13 +778,8 @@ Function *function() {
   }
   leave_scope(sc);
 
-  // Create a Function node
-  Function *fn = calloc(1, sizeof(Function));
-  fn->name = name;
-  fn->params = params;
   fn->node = head.next;
   fn->locals = locals;
-
   return fn;
 }
 
@@ -410,9 +795,21 @@ Node *stmt() {
   return node;
 }
 
+// Parses the body of a loop or "switch", which "break" may jump out of.
+Node *breakable_stmt() {
+  break_targets++;
+  Node *node = stmt();
+  break_targets--;
+  return node;
+}
+
 // stmt = "if" "(" expr ")" stmt ("else" stmt)?
 //      | "while" "(" expr ")" stmt
 //      | "for" "(" expr ";" expr ";" expr ")" stmt
+//      | "switch" "(" expr ")" stmt
+//      | "case" expr ":" stmt
+//      | "default" ":" stmt
+//      | "break" ";"
 //      | "return" expr ";"
 //      | "{" stmt* "}"
 //      | "typedef" basetype ident ("[" num "]")* ";"
@@ -440,7 +837,7 @@ Node *stmt_inner() {
     expect("(");
     node->cond = expr();
     expect(")");
-    node->cons = stmt();
+    node->cons = breakable_stmt();
     return node;
   }
 
@@ -460,10 +857,86 @@ Node *stmt_inner() {
       node->updt = read_expr_stmt();
       expect(")");
     }
-    node->cons = stmt();
+    node->cons = breakable_stmt();
+    return node;
+  }
+
+  // Parse "switch" statement. Case values are converted to the promoted type
+  // of the controlling expression, which is how codegen compares them.
+  if ((tok = consume("switch"))) {
+    Node *node = new_node(ND_SWITCH, tok);
+    expect("(");
+    node->cond = expr();
+    expect(")");
+    add_type(node->cond);
+    Type *type = node->cond->type;
+    if (!is_integer(type)) {
+      error_tok(node->cond->tok, "switch quantity is not an integer");
+    }
+
+    Switch sw = {};
+    sw.outer = cur_switch;
+    sw.type = type->size < 4 ? int_type : type;
+    cur_switch = &sw;
+    node->cons = breakable_stmt();
+    cur_switch = sw.outer;
+
+    for (CaseVal *cv = sw.vals; cv;) {
+      CaseVal *next = cv->next;
+      free(cv);
+      cv = next;
+    }
+    return node;
+  }
+
+  // Parse "case" label
+  if ((tok = consume("case"))) {
+    if (!cur_switch) {
+      error_tok(tok, "case label not within a switch statement");
+    }
+    Node *expr_node = expr();
+    add_type(expr_node);
+    long val = extend_const(eval(expr_node), cur_switch->type);
+    expect(":");
+    for (CaseVal *cv = cur_switch->vals; cv; cv = cv->next) {
+      if (cv->val == val) {
+        error_tok(tok, "duplicate case value");
+      }
+    }
+    CaseVal *cv = calloc(1, sizeof(CaseVal));
+    cv->val = val;
+    cv->next = cur_switch->vals;
+    cur_switch->vals = cv;
+
+    Node *node = new_unary(ND_CASE, stmt(), tok);
+    node->val = val;
     return node;
   }
 
+  // Parse "default" label
+  if ((tok = consume("default"))) {
+    if (!cur_switch) {
+      error_tok(tok, "default label not within a switch statement");
+    }
+    if (cur_switch->has_default) {
+      error_tok(tok, "multiple default labels in one switch");
+    }
+    cur_switch->has_default = true;
+    expect(":");
+    Node *node = new_unary(ND_CASE, stmt(), tok);
+    node->is_default = true;
+    return node;
+  }
+
+  // Parse "break" statement
+  if ((tok = consume("break"))) {
+    if (!break_targets) {
+      error_tok(tok, "break statement not within loop or switch");
+    }
+    expect(";");
+    return new_node(ND_BREAK, tok);
+  }
+
   // Parse "return" statement
   if ((tok = consume("return"))) {
     Node *node = new_unary(ND_RETURN, expr(), tok);
@@ -507,7 +980,108 @@ Node *stmt_inner() {
   return node;
 }
 
-// declaration = basetype ident ("[" num "]")* ("=" expr)? ";"
+// Path from a local variable to a sub-object being initialized, innermost
+// first.
+typedef struct Designator Designator;
+struct Designator {
+  Designator *next;
+  int idx;     // Array index
+  Member *mem; // Struct member
+};
+
+// Creates an lvalue node for the sub-object of `var` designated by `desg`.
+Node *new_desg_node(Var *var, Designator *desg, Token *tok) {
+  if (!desg) {
+    return new_var_node(var, tok);
+  }
+
+  Node *node = new_desg_node(var, desg->next, tok);
+  if (desg->mem) {
+    node = new_unary(ND_MEMBER, node, tok);
+    node->member = desg->mem;
+    return node;
+  }
+  node = new_add(node, new_num(desg->idx, tok), tok);
+  return new_unary(ND_DEREF, node, tok);
+}
+
+// Appends a statement which assigns `rhs` to a sub-object of `var`. Storing
+// a zero is omitted, since the variable has been zero-filled.
+Node *lvar_init_store(Node *cur, Var *var, Designator *desg, Node *rhs,
+                      Token *tok) {
+  if (rhs->kind == ND_NUM && rhs->val == 0) {
+    return cur;
+  }
+  Node *lhs = new_desg_node(var, desg, tok);
+  Node *node = new_binary(ND_ASSIGN, lhs, rhs, tok);
+  cur->next = new_unary(ND_EXPR_STMT, node, tok);
+  return cur->next;
+}
+
+// initializer = "{" (initializer ("," initializer)* ","?)? "}"
+//             | str
+//             | assign
+//
+// Reads the initializer of a sub-object of a local variable and appends the
+// statements storing its elements to `cur`.
+Node *lvar_initializer(Node *cur, Var *var, Type *type, Designator *desg) {
+  Token *tok = token;
+
+  if (type->kind == TYPE_ARRAY && type->base->kind == TYPE_CHAR &&
+      tok->kind == TK_STR) {
+    token = token->next;
+    if (tok->cont_len - 1 > type->array_len) {
+      error_tok(tok, "initializer-string is too long");
+    }
+    for (int i = 0; i < tok->cont_len && i < type->array_len; i++) {
+      Designator d = {desg, i, NULL};
+      cur = lvar_init_store(cur, var, &d, new_num(tok->contents[i], tok), tok);
+    }
+    return cur;
+  }
+
+  if (type->kind == TYPE_ARRAY) {
+    expect("{");
+    int i = 0;
+    if (!consume("}")) {
+      do {
+        if (i == type->array_len) {
+          error_tok(token, "excess elements in array initializer");
+        }
+        Designator d = {desg, i++, NULL};
+        cur = lvar_initializer(cur, var, type->base, &d);
+      } while (!consume_end());
+    }
+    return cur;
+  }
+
+  if (type->kind == TYPE_STRUCT && consume("{")) {
+    Member *mem = type->members;
+    if (!consume("}")) {
+      do {
+        if (!mem) {
+          error_tok(token, "excess elements in struct initializer");
+        }
+        Designator d = {desg, 0, mem};
+        cur = lvar_initializer(cur, var, mem->type, &d);
+        mem = mem->next;
+      } while (!consume_end());
+    }
+    return cur;
+  }
+
+  // A scalar may be enclosed in braces
+  if (type->kind != TYPE_STRUCT && consume("{")) {
+    cur = lvar_initializer(cur, var, type, desg);
+    consume(",");
+    expect("}");
+    return cur;
+  }
+
+  return lvar_init_store(cur, var, desg, assign(), tok);
+}
+
+// declaration = basetype ident ("[" num "]")* ("=" initializer)? ";"
 //             | basetype ";"
 Node *declaration() {
   Token *tok = token;
@@ -525,8 +1099,26 @@ Node *declaration() {
   }
 
   expect("=");
+
+  // An array or struct initialized by a list is zero-filled in bulk first,
+  // so only the elements given explicitly have to be stored afterwards.
+  if (type->kind == TYPE_ARRAY ||
+      (type->kind == TYPE_STRUCT && peek("{"))) {
+    Node *node = new_node(ND_BLOCK, tok);
+    node->body = new_unary(ND_MEMZERO, new_var_node(var, tok), tok);
+    lvar_initializer(node->body, var, type, NULL);
+    expect(";");
+    return node;
+  }
+
+  // A scalar may be enclosed in braces
+  bool brace = consume("{");
   Node *lhs = new_var_node(var, tok);
   Node *rhs = expr();
+  if (brace) {
+    consume(",");
+    expect("}");
+  }
   expect(";");
   Node *node = new_binary(ND_ASSIGN, lhs, rhs, tok);
   return new_unary(ND_EXPR_STMT, node, tok);
@@ -535,12 +1127,47 @@ Node *declaration() {
 // expr = assign
 Node *expr() { return assign(); }
 
-// assign = equality ("=" assign)?
+// Creates a compound assignment "lhs op= rhs". The operation reads the left
+// operand through an ND_LHS_VAL node, so that the address of the left operand
+// is computed only once.
+Node *new_op_assign(Node *lhs, NodeKind kind, Node *rhs, Token *tok) {
+  add_type(lhs);
+  Node *val = new_node(ND_LHS_VAL, tok);
+  val->type = lhs->type;
+
+  Node *op;
+  if (kind == ND_ADD) {
+    op = new_add(val, rhs, tok);
+  } else if (kind == ND_SUB) {
+    op = new_sub(val, rhs, tok);
+  } else {
+    op = new_binary(kind, val, rhs, tok);
+  }
+  if (op->lhs != val || op->kind == ND_PTR_DIFF) {
+    error_tok(tok, "invalid operands");
+  }
+  return new_binary(ND_OP_ASSIGN, lhs, op, tok);
+}
+
+// assign    = equality (assign-op assign)?
+// assign-op = "=" | "+=" | "-=" | "*=" | "/="
 Node *assign() {
   Node *node = equality();
-  Token *tok = consume("=");
-  if (tok) {
-    node = new_binary(ND_ASSIGN, node, assign(), tok);
+  Token *tok;
+  if ((tok = consume("="))) {
+    return new_binary(ND_ASSIGN, node, assign(), tok);
+  }
+  if ((tok = consume("+="))) {
+    return new_op_assign(node, ND_ADD, assign(), tok);
+  }
+  if ((tok = consume("-="))) {
+    return new_op_assign(node, ND_SUB, assign(), tok);
+  }
+  if ((tok = consume("*="))) {
+    return new_op_assign(node, ND_MUL, assign(), tok);
+  }
+  if ((tok = consume("/="))) {
+    return new_op_assign(node, ND_DIV, assign(), tok);
   }
   return node;
 }
@@ -648,10 +1275,15 @@ Node *mul() {
 }
 
 // unary = ("+" | "-" | "&" | "*" | "sizeof")? unary
+//       | ("++" | "--") unary
 //       | postfix
 Node *unary() {
   Token *tok;
-  if ((tok = consume("+"))) {
+  if ((tok = consume("++"))) {
+    return new_op_assign(unary(), ND_ADD, new_num(1, tok), tok);
+  } else if ((tok = consume("--"))) {
+    return new_op_assign(unary(), ND_SUB, new_num(1, tok), tok);
+  } else if ((tok = consume("+"))) {
     return unary();
   } else if ((tok = consume("-"))) {
     return new_binary(ND_SUB, new_num(0, tok), unary(), tok);
@@ -694,7 +1326,7 @@ Node *struct_ref(Node *lhs) {
   return node;
 }
 
-// postfix = primary ("[" expr "]" | "." ident | "->" ident)*
+// postfix = primary ("[" expr "]" | "." ident | "->" ident | "++" | "--")*
 Node *postfix() {
   Node *node = primary();
   Token *tok;
@@ -719,6 +1351,18 @@ Node *postfix() {
       continue;
     }
 
+    if ((tok = consume("++"))) {
+      node = new_op_assign(node, ND_ADD, new_num(1, tok), tok);
+      node->is_postfix = true;
+      continue;
+    }
+
+    if ((tok = consume("--"))) {
+      node = new_op_assign(node, ND_SUB, new_num(1, tok), tok);
+      node->is_postfix = true;
+      continue;
+    }
+
     return node;
   }
 }
@@ -732,6 +1376,20 @@ char *new_label() {
   return strndup(buf, 20);
 }
 
+// Checks the number of arguments of a call to a declared function.
+void check_func_args(Node *node) {
+  int n_args = 0;
+  for (Node *arg = node->args; arg; arg = arg->next) {
+    n_args++;
+  }
+
+  Function *fn = node->func;
+  if (n_args < fn->n_params || (!fn->is_variadic && n_args > fn->n_params)) {
+    error_tok(node->tok, "%s: expected %d arguments, but got %d", fn->name,
+              fn->n_params, n_args);
+  }
+}
+
 // primary = stmt-expr
 //         | "(" expr ")"
 //         | ident func-args?
@@ -758,6 +1416,12 @@ Node *primary() {
       Node *node = new_node(ND_CALL, tok);
       node->func_name = strndup(tok->str, tok->len);
       node->args = func_args();
+
+      VarScope *sc = find_var(tok);
+      if (sc && sc->func) {
+        node->func = sc->func;
+        check_func_args(node);
+      }
       return node;
     }
 
@@ -784,7 +1448,10 @@ Node *primary() {
     error_tok(tok, "expected expression");
   }
 
-  return new_num(expect_number(), tok);
+  Node *node = new_num(tok->val, tok);
+  node->type = tok->type;
+  token = token->next;
+  return node;
 }
 
 // stmt-expr = "(" "{" stmt stmt* "}" ")"
@@ -0,0 +1,141 @@
+#include "9cc.h"
+
+// A branch is cold if it is taken in less than 1/COLD_RATIO of the times its
+// condition is evaluated.
+#define COLD_RATIO 10
+
+// A function is hot if it is entered at least 1/HOT_RATIO as many times as
+// the most frequently entered function.
+#define HOT_RATIO 100
+
+// Number of profile counters. Counter 0 counts the runs of the program, and
+// the others are assigned by assign_function_counters().
+int n_prof_counters = 1;
+
+// Counter values read by read_profile(), or NULL if there is no profile
+long *prof_counts;
+
+// Entry count of the most frequently entered function
+long max_entry_count;
+
+void assign_node_counters(Node *node) {
+  if (!node) {
+    return;
+  }
+
+  // An "if", "while" or "for" statement gets two counters, one for the
+  // evaluations of its condition and one for the times it was true.
+  if (node->kind == ND_IF || node->kind == ND_WHILE || node->kind == ND_FOR) {
+    node->prof_id = n_prof_counters;
+    n_prof_counters += 2;
+  }
+
+  assign_node_counters(node->lhs);
+  assign_node_counters(node->rhs);
+  assign_node_counters(node->cond);
+  assign_node_counters(node->cons);
+  assign_node_counters(node->alt);
+  assign_node_counters(node->init);
+  assign_node_counters(node->updt);
+  for (Node *n = node->body; n; n = n->next) {
+    assign_node_counters(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    assign_node_counters(n);
+  }
+}
+
+// Numbers the profile counters of the entries and branches of a function.
+// This must run before any pass transforms the AST, so that an instrumented
+// build and a build using its profile agree on the numbering.
+void assign_function_counters(Function *fn) {
+  fn->prof_id = n_prof_counters++;
+  for (Node *node = fn->node; node; node = node->next) {
+    assign_node_counters(node);
+  }
+}
+
+void assign_profile_counters(Program *prog) {
+  for (Function *fn = prog->fns; fn; fn = fn->next) {
+    assign_function_counters(fn);
+  }
+}
+
+// Reads the counters dumped by a program built with -fprofile-generate.
+// A profile which doesn't match the program is ignored with a warning, as
+// the source may have changed since it was recorded.
+void read_profile(Program *prog, char *path) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    error("cannot open %s: %s", path, strerror(errno));
+  }
+
+  long *counts = calloc(n_prof_counters, sizeof(long));
+  int n = 0;
+  long val;
+  while (fscanf(fp, "%ld", &val) == 1) {
+    if (n < n_prof_counters) {
+      counts[n] = val;
+    }
+    n++;
+  }
+  fclose(fp);
+
+  if (n != n_prof_counters) {
+    fprintf(stderr, "%s: profile has %d counters but %d are expected; "
+                    "ignoring it\n",
+            path, n, n_prof_counters);
+    return;
+  }
+
+  prof_counts = counts;
+  for (Function *fn = prog->fns; fn; fn = fn->next) {
+    if (max_entry_count < prof_counts[fn->prof_id]) {
+      max_entry_count = prof_counts[fn->prof_id];
+    }
+  }
+}
+
+// Returns true if the profile shows that the condition of an "if" statement
+// is more often false than true.
+bool is_unlikely(Node *node) {
+  if (!prof_counts) {
+    return false;
+  }
+  long evals = prof_counts[node->prof_id];
+  long taken = prof_counts[node->prof_id + 1];
+  return taken * 2 < evals;
+}
+
+// Returns true if the profile shows that the condition of an "if" statement
+// is rarely true.
+bool is_cold_branch(Node *node) {
+  if (!prof_counts) {
+    return false;
+  }
+  long evals = prof_counts[node->prof_id];
+  long taken = prof_counts[node->prof_id + 1];
+  return taken * COLD_RATIO < evals;
+}
+
+// Returns true if the profile shows that the condition of an "if" statement
+// is rarely false.
+bool is_cold_else(Node *node) {
+  if (!prof_counts) {
+    return false;
+  }
+  long evals = prof_counts[node->prof_id];
+  long taken = prof_counts[node->prof_id + 1];
+  return (evals - taken) * COLD_RATIO < evals;
+}
+
+// Returns true if the profile shows that a function is never entered.
+bool is_cold_function(Function *fn) {
+  return prof_counts && prof_counts[fn->prof_id] == 0;
+}
+
+// Returns true if the profile shows that a function is entered often.
+bool is_hot_function(Function *fn) {
+  return prof_counts && prof_counts[fn->prof_id] > 0 &&
+         prof_counts[fn->prof_id] * HOT_RATIO >= max_entry_count;
+}
@@ -0,0 +1,174 @@
+#include "9cc.h"
+#include <sys/resource.h>
+#include <time.h>
+
+// Time spent in a phase of the compiler
+typedef struct Phase Phase;
+struct Phase {
+  Phase *next;
+  char *name;
+  double wall; // Wall-clock time in milliseconds
+  double cpu;  // CPU time in milliseconds
+  long rss;    // Peak resident set size in kilobytes at the end
+};
+
+Phase *phases;
+Phase *last_phase;
+
+// Time at the end of the last phase
+double mark_wall;
+double mark_cpu;
+
+// Number and total size of allocated objects of each kind
+long object_count[OBJ_KINDS];
+long object_bytes[OBJ_KINDS];
+
+char *object_names[] = {"Token", "Node", "Type", "Var", "scope entry"};
+
+// Block of memory from which nodes are allocated while a region is open.
+// `data` is aligned like memory returned by malloc.
+typedef struct Chunk Chunk;
+struct Chunk {
+  Chunk *next;
+  long used;
+  _Alignas(16) char data[];
+};
+
+#define CHUNK_SIZE 8192
+
+bool in_region;
+Chunk *region;
+
+// Returns the peak resident set size of the process in kilobytes.
+long peak_rss() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Returns the time of a clock in milliseconds.
+double now(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Allocates a zero-filled object, counting it in the statistics of its kind.
+// While a region is open, nodes are allocated from it.
+void *new_object(ObjectKind kind, int size) {
+  object_count[kind]++;
+  object_bytes[kind] += size;
+  if (!in_region || kind != OBJ_NODE) {
+    return calloc(1, size);
+  }
+
+  size = align_to(size, 16);
+  if (!region || region->used + size > CHUNK_SIZE) {
+    int cap = size > CHUNK_SIZE ? size : CHUNK_SIZE;
+    Chunk *chunk = calloc(1, sizeof(Chunk) + cap);
+    chunk->next = region;
+    region = chunk;
+  }
+  void *obj = region->data + region->used;
+  region->used += size;
+  return obj;
+}
+
+// Starts or resumes allocating AST nodes from the region, which frees them
+// all at once when released. Nodes may be shared within a tree, so they
+// can't be freed by walking the tree.
+void begin_region() {
+  in_region = true;
+}
+
+// Allocates nodes individually again, leaving those in the region as is.
+void end_region() {
+  in_region = false;
+}
+
+// Frees all nodes allocated in the region.
+void release_region() {
+  while (region) {
+    Chunk *next = region->next;
+    free(region);
+    region = next;
+  }
+  in_region = false;
+}
+
+// Starts timing the first phase.
+void start_phases() {
+  mark_wall = now(CLOCK_MONOTONIC);
+  mark_cpu = now(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+// Records the time since the end of the previous phase as the time spent in
+// phase `name`.
+void end_phase(char *name) {
+  double wall = now(CLOCK_MONOTONIC);
+  double cpu = now(CLOCK_PROCESS_CPUTIME_ID);
+
+  Phase *phase = calloc(1, sizeof(Phase));
+  phase->name = name;
+  phase->wall = wall - mark_wall;
+  phase->cpu = cpu - mark_cpu;
+  phase->rss = peak_rss();
+  if (last_phase) {
+    last_phase->next = phase;
+  } else {
+    phases = phase;
+  }
+  last_phase = phase;
+
+  mark_wall = wall;
+  mark_cpu = cpu;
+}
+
+void print_stats_text() {
+  double wall = 0;
+  double cpu = 0;
+  fprintf(stderr, "%-20s %12s %12s %14s\n", "phase", "wall (ms)", "cpu (ms)",
+          "peak RSS (KB)");
+  for (Phase *p = phases; p; p = p->next) {
+    fprintf(stderr, "%-20s %12.3f %12.3f %14ld\n", p->name, p->wall, p->cpu,
+            p->rss);
+    wall += p->wall;
+    cpu += p->cpu;
+  }
+  fprintf(stderr, "%-20s %12.3f %12.3f\n", "total", wall, cpu);
+  fprintf(stderr, "peak RSS: %ld KB\n\n", peak_rss());
+
+  fprintf(stderr, "%-20s %12s %12s\n", "object", "count", "bytes");
+  for (int i = 0; i < OBJ_KINDS; i++) {
+    fprintf(stderr, "%-20s %12ld %12ld\n", object_names[i], object_count[i],
+            object_bytes[i]);
+  }
+}
+
+void print_stats_json() {
+  fprintf(stderr, "{\n  \"phases\": [");
+  for (Phase *p = phases; p; p = p->next) {
+    fprintf(stderr,
+            "%s\n    {\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+            "\"peak_rss_kb\": %ld}",
+            p == phases ? "" : ",", p->name, p->wall, p->cpu, p->rss);
+  }
+  fprintf(stderr, "\n  ],\n  \"peak_rss_kb\": %ld,\n", peak_rss());
+
+  fprintf(stderr, "  \"objects\": {");
+  for (int i = 0; i < OBJ_KINDS; i++) {
+    fprintf(stderr, "%s\n    \"%s\": {\"count\": %ld, \"bytes\": %ld}",
+            i ? "," : "", object_names[i], object_count[i], object_bytes[i]);
+  }
+  fprintf(stderr, "\n  }\n}\n");
+}
+
+// Prints the time spent in each phase, the peak memory usage and the
+// numbers of allocated objects to stderr.
+void print_stats(bool json) {
+  if (json) {
+    print_stats_json();
+  } else {
+    print_stats_text();
+  }
+}
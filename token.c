@@ -135,7 +135,7 @@ char *expect_ident() {
 
 // Creates a new token and links it to the current token `cur`.
 Token *new_token(TokenKind kind, Token *cur, char *str, int len) {
-  Token *tok = calloc(1, sizeof(Token));
+  Token *tok = new_object(OBJ_TOKEN, sizeof(Token));
   tok->kind = kind;
   tok->str = str;
   tok->len = len;
@@ -153,12 +153,48 @@ bool is_alpha(char c) {
 
 bool is_alphanum(char c) { return is_alpha(c) || ('0' <= c && c <= '9'); }
 
+// Reads the "u" and "l" suffixes of an integer literal and decides its type,
+// which is the first of int, long and their unsigned variants allowed by the
+// suffixes that can represent the value.
+char *read_int_suffix(Token *tok, char *p) {
+  bool u = false;
+  bool l = false;
+  for (;;) {
+    if ((*p == 'u' || *p == 'U') && !u) {
+      u = true;
+      p++;
+    } else if ((*p == 'l' || *p == 'L') && !l) {
+      l = true;
+      p += p[1] == p[0] ? 2 : 1;
+    } else {
+      break;
+    }
+  }
+  if (is_alphanum(*p)) {
+    error_at(p, "invalid suffix on integer constant");
+  }
+
+  unsigned long val = tok->val;
+  if (!l && !u && val <= INT_MAX) {
+    tok->type = int_type;
+  } else if (!l && u && val <= UINT_MAX) {
+    tok->type = uint_type;
+  } else if (!u && val <= LONG_MAX) {
+    tok->type = long_type;
+  } else {
+    tok->type = ulong_type;
+  }
+  return p;
+}
+
 // Reads a reserved symbol or keyword from `p`. If no reserved token is found,
 // it returns NULL.
 char *read_reserved(char *p) {
   // Keywords
-  char *kw[] = {"return", "if",   "else",   "while",  "for",
-                "int",    "char", "struct", "sizeof", "typedef"};
+  char *kw[] = {"return",   "if",     "else",   "while",   "for",
+                "switch",   "case",   "default", "break",  "int",
+                "char",     "short",  "long",   "signed",  "unsigned",
+                "struct",   "sizeof", "typedef", "static",  "extern"};
 
   for (int i = 0; i < sizeof(kw) / sizeof(*kw); i++) {
     int len = strlen(kw[i]);
@@ -168,7 +204,8 @@ char *read_reserved(char *p) {
   }
 
   // Multi-letter punctuators
-  char *ops[] = {"==", "!=", "<=", ">=", "->"};
+  char *ops[] = {"...", "==", "!=", "<=", ">=", "->", "+=",
+                 "-=",  "*=", "/=", "++", "--"};
 
   for (int i = 0; i < sizeof(ops) / sizeof(*ops); i++) {
     if (start_with(p, ops[i])) {
@@ -236,11 +273,34 @@ Token *read_string_literal(Token *cur, char *start) {
   return tok;
 }
 
-// Tokenizes an input string `p` and returns the first token.
-Token *tokenize() {
-  char *p = user_input;
-  Token head = {};
-  Token *cur = &head;
+// Position in the input up to which lines have been counted, and the line
+// number there
+char *line_pos;
+int line_no = 1;
+
+// Sets the line number of each token, counting newlines between a token and
+// the next in a single pass over the input. Tokens must be numbered in order.
+void add_line_numbers(Token *tok) {
+  if (!line_pos) {
+    line_pos = user_input;
+  }
+  for (; tok; tok = tok->next) {
+    for (; line_pos < tok->str; line_pos++) {
+      if (*line_pos == '\n') {
+        line_no++;
+      }
+    }
+    tok->line_no = line_no;
+  }
+}
+
+// Position in the input at which tokenizing continues
+char *tokenize_pos;
+
+// Reads the next token from the input, skipping whitespaces and comments, and
+// links it to `cur`. Returns NULL at the end of input.
+Token *read_token(Token *cur) {
+  char *p = tokenize_pos;
 
   while (*p) {
     // Whitespaces
@@ -271,17 +331,16 @@ Token *tokenize() {
     // String literals
     if (*p == '"') {
       cur = read_string_literal(cur, p);
-      p += cur->len;
-      continue;
+      tokenize_pos = p + cur->len;
+      return cur;
     }
 
     // Keywords or multi-letter punctuators
     char *kw = read_reserved(p);
     if (kw) {
       int len = strlen(kw);
-      cur = new_token(TK_RESERVED, cur, p, len);
-      p += len;
-      continue;
+      tokenize_pos = p + len;
+      return new_token(TK_RESERVED, cur, p, len);
     }
 
     // Identifiers
@@ -290,28 +349,83 @@ Token *tokenize() {
       while (is_alphanum(*p)) {
         p++;
       }
-      cur = new_token(TK_IDENT, cur, name, p - name);
-      continue;
+      tokenize_pos = p;
+      return new_token(TK_IDENT, cur, name, p - name);
     }
 
     // Single-letter punctuators
     if (ispunct(*p)) {
-      cur = new_token(TK_RESERVED, cur, p++, 1);
-      continue;
+      tokenize_pos = p + 1;
+      return new_token(TK_RESERVED, cur, p, 1);
     }
 
     // Numbers
     if (isdigit(*p)) {
       cur = new_token(TK_NUM, cur, p, 0);
       char *prev = p;
-      cur->val = strtol(p, &p, 10);
+      cur->val = strtoul(p, &p, 10);
+      p = read_int_suffix(cur, p);
       cur->len = p - prev;
-      continue;
+      tokenize_pos = p;
+      return cur;
     }
 
     error_at(p, "Could not tokenize the string.");
   }
 
-  new_token(TK_EOF, cur, p, 0);
+  tokenize_pos = p;
+  return NULL;
+}
+
+// Returns true if a token is the given reserved punctuator.
+bool is_punct(Token *tok, char *s) {
+  return tok->kind == TK_RESERVED && tok->len == 1 && tok->str[0] == *s;
+}
+
+// Tokenizes an input string `p` and returns the first token.
+Token *tokenize() {
+  tokenize_pos = user_input;
+  Token head = {};
+  Token *cur = &head;
+  for (Token *tok = read_token(cur); tok; tok = read_token(cur)) {
+    cur = tok;
+  }
+
+  new_token(TK_EOF, cur, tokenize_pos, 0);
+  add_line_numbers(head.next);
+  return head.next;
+}
+
+// Tokenizes the input from where the previous call stopped up to the end of
+// the next function definition, so that the tokens of the rest of the input
+// don't exist yet. The tokens end with TK_EOF, which is the end of input if
+// there is no function definition left. A function body is a brace at the
+// outermost level which follows a closing parenthesis.
+Token *tokenize_function() {
+  if (!tokenize_pos) {
+    tokenize_pos = user_input;
+  }
+  Token head = {};
+  Token *cur = &head;
+  int depth = 0;
+  bool in_body = false;
+  for (Token *tok = read_token(cur); tok; tok = read_token(cur)) {
+    if (is_punct(tok, "(") || is_punct(tok, "[") || is_punct(tok, "{")) {
+      if (depth == 0 && is_punct(tok, "{") && is_punct(cur, ")")) {
+        in_body = true;
+      }
+      depth++;
+    } else if (is_punct(tok, ")") || is_punct(tok, "]") ||
+               is_punct(tok, "}")) {
+      depth--;
+    }
+    cur = tok;
+    if (in_body && depth == 0) {
+      break;
+    }
+  }
+
+  new_token(TK_EOF, cur, tokenize_pos, 0);
+  add_line_numbers(head.next);
   return head.next;
 }
@@ -1,10 +1,22 @@
 #include "9cc.h"
 
 Type *char_type = &(Type){.kind = TYPE_CHAR, .size = 1, .align = 1};
-Type *int_type = &(Type){.kind = TYPE_INT, .size = 8, .align = 8};
+Type *short_type = &(Type){.kind = TYPE_SHORT, .size = 2, .align = 2};
+Type *int_type = &(Type){.kind = TYPE_INT, .size = 4, .align = 4};
+Type *long_type = &(Type){.kind = TYPE_LONG, .size = 8, .align = 8};
+
+Type *uchar_type =
+    &(Type){.kind = TYPE_CHAR, .size = 1, .align = 1, .is_unsigned = true};
+Type *ushort_type =
+    &(Type){.kind = TYPE_SHORT, .size = 2, .align = 2, .is_unsigned = true};
+Type *uint_type =
+    &(Type){.kind = TYPE_INT, .size = 4, .align = 4, .is_unsigned = true};
+Type *ulong_type =
+    &(Type){.kind = TYPE_LONG, .size = 8, .align = 8, .is_unsigned = true};
 
 bool is_integer(Type *type) {
-  return type->kind == TYPE_CHAR || type->kind == TYPE_INT;
+  TypeKind k = type->kind;
+  return k == TYPE_CHAR || k == TYPE_SHORT || k == TYPE_INT || k == TYPE_LONG;
 }
 
 // Aligns `n` to the multiple of `align`.
@@ -14,7 +26,7 @@ bool is_integer(Type *type) {
 int align_to(int n, int align) { return (n + align - 1) & ~(align - 1); }
 
 Type *new_type(TypeKind kind, int size, int align) {
-  Type *type = calloc(1, sizeof(Type));
+  Type *type = new_object(OBJ_TYPE, sizeof(Type));
   type->kind = kind;
   type->size = size;
   type->align = align;
@@ -34,6 +46,90 @@ Type *array_of(Type *base, int len) {
   return type;
 }
 
+// Returns the type both operands of an arithmetic operator are converted to
+// by the usual arithmetic conversions. Operands narrower than int are
+// promoted to int first.
+Type *common_type(Type *ty1, Type *ty2) {
+  if (ty1->size < 4) {
+    ty1 = int_type;
+  }
+  if (ty2->size < 4) {
+    ty2 = int_type;
+  }
+  if (ty1->size != ty2->size) {
+    return ty1->size < ty2->size ? ty2 : ty1;
+  }
+  return ty2->is_unsigned ? ty2 : ty1;
+}
+
+// Returns true if a comparison operator compares its operands as unsigned
+// values. Pointers are compared as unsigned addresses.
+bool is_unsigned_cmp(Node *node) {
+  Type *ty1 = node->lhs->type;
+  Type *ty2 = node->rhs->type;
+  if (!is_integer(ty1) || !is_integer(ty2)) {
+    return true;
+  }
+  return common_type(ty1, ty2)->is_unsigned;
+}
+
+// Returns true if two types are the same, as the types of a function in its
+// declarations must be.
+bool is_same_type(Type *a, Type *b) {
+  if (a->kind != b->kind || a->is_unsigned != b->is_unsigned) {
+    return false;
+  }
+
+  switch (a->kind) {
+  case TYPE_PTR:
+    return is_same_type(a->base, b->base);
+  case TYPE_ARRAY:
+    return a->array_len == b->array_len && is_same_type(a->base, b->base);
+  case TYPE_STRUCT:
+    return a == b;
+  default:
+    return true;
+  }
+}
+
+// Returns true if converting a value from type `from` to `to` doesn't
+// change its representation in a register. Integers are held in 64-bit
+// registers sign-extended if signed, and zero-extended if unsigned.
+bool is_same_repr(Type *from, Type *to) {
+  if (to->size == 8) {
+    return true;
+  }
+  if (from->size < to->size) {
+    return from->is_unsigned || !to->is_unsigned;
+  }
+  return from->size == to->size && from->is_unsigned == to->is_unsigned;
+}
+
+// Converts an expression to an integer type, inserting an ND_CAST node only
+// if the conversion needs an instruction.
+Node *new_cast(Node *expr, Type *type) {
+  if (!is_integer(expr->type) || !is_integer(type) ||
+      is_same_repr(expr->type, type)) {
+    return expr;
+  }
+
+  Node *node = new_object(OBJ_NODE, sizeof(Node));
+  node->kind = ND_CAST;
+  node->tok = expr->tok;
+  node->lhs = expr;
+  node->type = type;
+  return node;
+}
+
+// Performs the usual arithmetic conversions on the operands of a binary
+// operator and returns their common type.
+Type *usual_arith_conv(Node *node) {
+  Type *type = common_type(node->lhs->type, node->rhs->type);
+  node->lhs = new_cast(node->lhs, type);
+  node->rhs = new_cast(node->rhs, type);
+  return type;
+}
+
 void add_type(Node *node) {
   if (!node || node->type) {
     return;
@@ -57,20 +153,43 @@ void add_type(Node *node) {
   switch (node->kind) {
   case ND_ADD:
   case ND_SUB:
-  case ND_PTR_DIFF:
   case ND_MUL:
   case ND_DIV:
+    node->type = usual_arith_conv(node);
+    return;
   case ND_EQ:
   case ND_NE:
   case ND_LT:
   case ND_LE:
-  case ND_CALL:
+    if (is_integer(node->lhs->type) && is_integer(node->rhs->type)) {
+      usual_arith_conv(node);
+    }
+    node->type = int_type;
+    return;
+  case ND_PTR_DIFF:
+    node->type = long_type;
+    return;
   case ND_NUM:
     node->type = int_type;
     return;
+  case ND_CALL:
+    // Structs are not passed by value
+    for (Node *n = node->args; n; n = n->next) {
+      if (n->type->kind == TYPE_STRUCT) {
+        error_tok(n->tok, "passing a struct by value is not supported");
+      }
+    }
+    // Implicitly declared functions are assumed to return int
+    node->type = node->func ? node->func->return_type : int_type;
+    return;
   case ND_PTR_ADD:
   case ND_PTR_SUB:
+    node->type = node->lhs->type;
+    return;
   case ND_ASSIGN:
+  case ND_OP_ASSIGN:
+    // The value of an assignment is the value stored to the left operand
+    node->rhs = new_cast(node->rhs, node->lhs->type);
     node->type = node->lhs->type;
     return;
   case ND_VAR:
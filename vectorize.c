@@ -0,0 +1,239 @@
+#include "9cc.h"
+
+// Returns true if the address of `var` is taken anywhere in a tree, in which
+// case a store through a pointer may modify it.
+bool takes_addr_of(Node *node, Var *var) {
+  if (!node) {
+    return false;
+  }
+  if (node->kind == ND_ADDR) {
+    Node *lhs = node->lhs;
+    while (lhs->kind == ND_MEMBER) {
+      lhs = lhs->lhs;
+    }
+    if (lhs->kind == ND_VAR && lhs->var == var) {
+      return true;
+    }
+  }
+
+  if (takes_addr_of(node->lhs, var) || takes_addr_of(node->rhs, var) ||
+      takes_addr_of(node->cond, var) || takes_addr_of(node->cons, var) ||
+      takes_addr_of(node->alt, var) || takes_addr_of(node->init, var) ||
+      takes_addr_of(node->updt, var)) {
+    return true;
+  }
+  for (Node *n = node->body; n; n = n->next) {
+    if (takes_addr_of(n, var)) {
+      return true;
+    }
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    if (takes_addr_of(n, var)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Function being vectorized
+Function *vec_fn;
+
+// Returns true if `node` is a local scalar variable which only the loop's own
+// assignments could modify.
+bool is_private_var(Node *node) {
+  if (node->kind != ND_VAR || !node->var->is_local) {
+    return false;
+  }
+  TypeKind kind = node->var->type->kind;
+  if (kind == TYPE_ARRAY || kind == TYPE_STRUCT) {
+    return false;
+  }
+  for (Node *n = vec_fn->node; n; n = n->next) {
+    if (takes_addr_of(n, node->var)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns true if `node` is an integer which is the same in every iteration
+// of a loop over `iv`.
+bool is_loop_invariant(Node *node, Var *iv) {
+  if (node->kind == ND_NUM) {
+    return true;
+  }
+  return is_private_var(node) && node->var != iv && is_integer(node->type);
+}
+
+// Returns true if `node` is the address of an array which a store in the loop
+// cannot change: an array variable or a private pointer variable.
+bool is_vector_base(Node *node, Var *iv) {
+  if (node->kind != ND_VAR) {
+    return false;
+  }
+  if (node->type->kind == TYPE_ARRAY) {
+    return true;
+  }
+  return node->type->kind == TYPE_PTR && node->var != iv &&
+         is_private_var(node);
+}
+
+// Returns true if `node` is "base[iv]" for an array of `size`-byte integers.
+bool is_vector_access(Node *node, Var *iv, int size) {
+  if (node->kind != ND_DEREF || !is_integer(node->type) ||
+      node->type->size != size) {
+    return false;
+  }
+  Node *addr = node->lhs;
+  return addr->kind == ND_PTR_ADD && is_vector_base(addr->lhs, iv) &&
+         addr->rhs->kind == ND_VAR && addr->rhs->var == iv;
+}
+
+// Returns true if `node` can be computed for `size`-byte elements at once:
+// an element access, a loop invariant, or a sum or difference of those.
+bool is_vector_operand(Node *node, Var *iv, int size) {
+  return is_vector_access(node, iv, size) || is_loop_invariant(node, iv);
+}
+
+bool is_vector_expr(Node *node, Var *iv, int size) {
+  // Vector elements wrap around, so truncation to the element type is
+  // implicit
+  if (node->kind == ND_CAST && node->type->size == size) {
+    return is_vector_expr(node->lhs, iv, size);
+  }
+  if (node->kind == ND_ADD || node->kind == ND_SUB) {
+    return is_vector_operand(node->lhs, iv, size) &&
+           is_vector_operand(node->rhs, iv, size);
+  }
+  return is_vector_operand(node, iv, size);
+}
+
+// Returns the assignment in a loop body if the body is "dst[iv] = expr;".
+Node *loop_assign(Node *node) {
+  if (node->kind == ND_BLOCK) {
+    if (!node->body || node->body->next) {
+      return NULL;
+    }
+    node = node->body;
+  }
+  if (node->kind != ND_EXPR_STMT || node->lhs->kind != ND_ASSIGN) {
+    return NULL;
+  }
+  return node->lhs;
+}
+
+// Returns true if `node` reads the induction variable `iv`, either directly
+// or as the left operand of a compound assignment to it.
+bool is_iv_value(Node *node, Var *iv) {
+  return (node->kind == ND_VAR && node->var == iv) ||
+         node->kind == ND_LHS_VAL;
+}
+
+// Returns true if a statement is "iv = iv + 1", "iv += 1" or "iv++".
+bool is_increment(Node *node, Var *iv) {
+  if (!node || node->kind != ND_EXPR_STMT ||
+      (node->lhs->kind != ND_ASSIGN && node->lhs->kind != ND_OP_ASSIGN)) {
+    return false;
+  }
+  Node *lhs = node->lhs->lhs;
+  Node *rhs = node->lhs->rhs;
+  if (lhs->kind != ND_VAR || lhs->var != iv || rhs->kind != ND_ADD) {
+    return false;
+  }
+  Node *a = rhs->lhs;
+  Node *b = rhs->rhs;
+  return (is_iv_value(a, iv) && b->kind == ND_NUM && b->val == 1) ||
+         (is_iv_value(b, iv) && a->kind == ND_NUM && a->val == 1);
+}
+
+// Vectorizes a loop of the form
+//
+//   for (init; iv < n; iv = iv + 1) dst[iv] = expr;
+//
+// where `expr` adds or subtracts elements of arrays at the same index and
+// loop invariants. The loop is split into a vector loop, which processes as
+// many elements as fit in a vector register per iteration, followed by the
+// original loop, which handles the remaining elements.
+void vectorize_loop(Node *node) {
+  Node *cond = node->cond;
+  if (!cond || cond->kind != ND_LT || cond->lhs->kind != ND_VAR) {
+    return;
+  }
+  Var *iv = cond->lhs->var;
+  if (!is_integer(iv->type) || iv->type->size < 4 || iv->type->is_unsigned ||
+      !is_private_var(cond->lhs) ||
+      !is_loop_invariant(cond->rhs, iv) || !is_increment(node->updt, iv)) {
+    return;
+  }
+
+  Node *assign = loop_assign(node->cons);
+  if (!assign) {
+    return;
+  }
+  int size = assign->lhs->type->size;
+  if (!is_vector_access(assign->lhs, iv, size) ||
+      !is_vector_expr(assign->rhs, iv, size)) {
+    return;
+  }
+
+  Node *vloop = new_object(OBJ_NODE, sizeof(Node));
+  vloop->kind = ND_VLOOP;
+  vloop->tok = node->tok;
+  vloop->var = iv;
+  vloop->cond = cond;
+  vloop->lhs = assign;
+
+  Node *loop = new_object(OBJ_NODE, sizeof(Node));
+  *loop = *node;
+  loop->init = NULL;
+  loop->next = NULL;
+  vloop->next = loop;
+
+  node->kind = ND_BLOCK;
+  node->body = vloop;
+  node->cond = node->cons = node->updt = NULL;
+  if (node->init) {
+    node->init->next = vloop;
+    node->body = node->init;
+    node->init = NULL;
+  }
+}
+
+void vectorize_stmt(Node *node) {
+  if (!node) {
+    return;
+  }
+
+  if (node->kind == ND_FOR) {
+    vectorize_loop(node);
+    if (node->kind != ND_FOR) {
+      return;
+    }
+  }
+
+  vectorize_stmt(node->lhs);
+  vectorize_stmt(node->rhs);
+  vectorize_stmt(node->cons);
+  vectorize_stmt(node->alt);
+  for (Node *n = node->body; n; n = n->next) {
+    vectorize_stmt(n);
+  }
+  for (Node *n = node->args; n; n = n->next) {
+    vectorize_stmt(n);
+  }
+}
+
+// Turns simple counted loops over arrays in a function into SIMD loops.
+void vectorize_function(Function *fn) {
+  vec_fn = fn;
+  for (Node *node = fn->node; node; node = node->next) {
+    vectorize_stmt(node);
+  }
+}
+
+// Turns simple counted loops over arrays into SIMD loops.
+void vectorize_loops(Program *prog) {
+  for (Function *fn = prog->fns; fn; fn = fn->next) {
+    vectorize_function(fn);
+  }
+}